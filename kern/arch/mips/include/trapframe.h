@@ -100,6 +100,12 @@ struct trapframe {
  */
 void mips_usermode(struct trapframe *tf);
 
+/*
+ * Syscall handler for the fast path in exception-mips1.S. Only part
+ * of the trapframe is filled in; see there.
+ */
+void mips_fastsyscall(struct trapframe *tf);
+
 /*
  * Arrays used to load the kernel stack and curthread on trap entry.
  */
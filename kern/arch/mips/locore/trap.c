@@ -36,9 +36,11 @@
 #include <spl.h>
 #include <thread.h>
 #include <current.h>
+#include <proc.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
+#include "opt-fastsyscall.h"
 
 
 /* in exception.S */
@@ -155,6 +157,8 @@ mips_trap(struct trapframe *tf)
 
 		old_in = curthread->t_in_interrupt;
 		curthread->t_in_interrupt = 1;
+		/* For hardclock's user/system time accounting */
+		curthread->t_userintr = !iskern;
 
 		/*
 		 * The processor has turned interrupts off; if the
@@ -194,6 +198,17 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+		/*
+		 * If the process is exiting, a user thread must not go
+		 * back to user mode. Turn interrupts back on, as for a
+		 * syscall, and go through the check below.
+		 */
+		if (!iskern && curproc->p_exiting) {
+			spl = splhigh();
+			splx(spl);
+			goto done;
+		}
 		goto done2;
 	}
 
@@ -314,6 +329,11 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+	/* See above; this catches syscalls and faults too. */
+	if (!iskern && curproc->p_exiting) {
+		uthread_exiting();
+	}
+
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
@@ -346,6 +366,40 @@ mips_trap(struct trapframe *tf)
 	KASSERT(SAME_STACK(cpustacks[curcpu->c_number]-1, (vaddr_t)tf));
 }
 
+#if OPT_FASTSYSCALL
+/*
+ * Syscall handler for the fast path in exception-mips1.S. This is
+ * the syscall case of mips_trap on its own.
+ */
+void
+mips_fastsyscall(struct trapframe *tf)
+{
+	int spl;
+
+	/* As in mips_trap, sync the interrupt state and turn them on. */
+	spl = splhigh();
+	splx(spl);
+
+	KASSERT(curthread->t_curspl == 0);
+	KASSERT(curthread->t_iplhigh_count == 0);
+
+	DEBUG(DB_SYSCALL, "syscall: #%d, args %x %x %x %x\n", 
+	      tf->tf_v0, tf->tf_a0, tf->tf_a1, tf->tf_a2, tf->tf_a3);
+
+	syscall(tf);
+
+	if (curproc->p_exiting) {
+		uthread_exiting();
+	}
+
+	cpu_irqoff();
+
+	/* We may have moved to another cpu; see the end of mips_trap. */
+	cputhreads[curcpu->c_number] = (vaddr_t)curthread;
+	cpustacks[curcpu->c_number] = (vaddr_t)curthread->t_stack + STACK_SIZE;
+}
+#endif /* OPT_FASTSYSCALL */
+
 /*
  * Function for entering user mode.
  *
@@ -429,3 +483,28 @@ enter_new_process(int argc, userptr_t argv, vaddr_t stack, vaddr_t entry)
 
 	mips_usermode(&tf);
 }
+
+/*
+ * enter_new_thread: go to user mode in a new thread of an existing
+ * process. It begins executing at ENTRY with A0 and A1 as its first
+ * two arguments, on the stack whose top is STACK.
+ *
+ * The calling convention lets the callee store its register arguments
+ * in 16 bytes the caller leaves at the bottom of its frame, so leave
+ * room for that.
+ */
+void
+enter_new_thread(vaddr_t entry, vaddr_t a0, vaddr_t a1, vaddr_t stack)
+{
+	struct trapframe tf;
+
+	bzero(&tf, sizeof(tf));
+
+	tf.tf_status = CST_IRQMASK | CST_IEp | CST_KUp;
+	tf.tf_epc = entry;
+	tf.tf_a0 = a0;
+	tf.tf_a1 = a1;
+	tf.tf_sp = stack - 16;
+
+	mips_usermode(&tf);
+}
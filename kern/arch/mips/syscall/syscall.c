@@ -36,8 +36,276 @@
 #include <current.h>
 #include <syscall.h>
 #include <kern/wait.h>
+#include <spinlock.h>
+#include <clock.h>
+#include "opt-syscallstat.h"
 
 
+/*
+ * Handlers. Each decodes the arguments of one system call from the
+ * trapframe, calls its implementation, and returns an error code; the
+ * return value, if any, goes in *RETVAL.
+ */
+
+static
+int
+sc_reboot(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_reboot(tf->tf_a0);
+}
+
+static
+int
+sc___time(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys___time((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_nanosleep(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_nanosleep((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc___thread_create(struct trapframe *tf, int32_t *retval)
+{
+	return sys___thread_create((userptr_t)tf->tf_a0,
+				   (userptr_t)tf->tf_a1,
+				   (userptr_t)tf->tf_a2,
+				   retval);
+}
+
+static
+int
+sc_thread_join(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_thread_join(tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_thread_exit(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	sys_thread_exit(tf->tf_a0);
+	panic("unexpected return from sys_thread_exit");
+	return 0;
+}
+
+static
+int
+sc_futex_wait(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_futex_wait((userptr_t)tf->tf_a0, tf->tf_a1);
+}
+
+static
+int
+sc_futex_wake(struct trapframe *tf, int32_t *retval)
+{
+	return sys_futex_wake((userptr_t)tf->tf_a0, tf->tf_a1, retval);
+}
+
+#ifdef UW
+static
+int
+sc_write(struct trapframe *tf, int32_t *retval)
+{
+	return sys_write((int)tf->tf_a0,
+			 (userptr_t)tf->tf_a1,
+			 (int)tf->tf_a2,
+			 (int *)retval);
+}
+
+static
+int
+sc__exit(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	sys__exit((int)tf->tf_a0, __WEXITED);
+	/* sys__exit does not return, execution should not get here */
+	panic("unexpected return from sys__exit");
+	return 0;
+}
+
+static
+int
+sc_getpid(struct trapframe *tf, int32_t *retval)
+{
+	(void)tf;
+	return sys_getpid((pid_t *)retval);
+}
+
+static
+int
+sc_waitpid(struct trapframe *tf, int32_t *retval)
+{
+	return sys_waitpid((pid_t)tf->tf_a0,
+			   (userptr_t)tf->tf_a1,
+			   (int)tf->tf_a2,
+			   (pid_t *)retval);
+}
+
+static
+int
+sc_fork(struct trapframe *tf, int32_t *retval)
+{
+	return sys_fork(tf, (pid_t *)retval);
+}
+
+static
+int
+sc_execv(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_execv((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_spawn(struct trapframe *tf, int32_t *retval)
+{
+	return sys_spawn((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+			 (pid_t *)retval);
+}
+
+static
+int
+sc_getrusage(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_getrusage((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+#endif // UW
+
+/*
+ * The table. Calls without an entry fail with ENOSYS.
+ */
+struct syscall_desc {
+	const char *sd_name;
+	int (*sd_handler)(struct trapframe *tf, int32_t *retval);
+};
+
+#define SYSCALL(name) [SYS_##name] = { #name, sc_##name }
+
+static const struct syscall_desc syscalls[] = {
+	SYSCALL(reboot),
+	SYSCALL(__time),
+	SYSCALL(nanosleep),
+	SYSCALL(__thread_create),
+	SYSCALL(thread_join),
+	SYSCALL(thread_exit),
+	SYSCALL(futex_wait),
+	SYSCALL(futex_wake),
+#ifdef UW
+	SYSCALL(write),
+	SYSCALL(_exit),
+	SYSCALL(getpid),
+	SYSCALL(waitpid),
+	SYSCALL(fork),
+	SYSCALL(execv),
+	SYSCALL(spawn),
+	SYSCALL(getrusage),
+#endif // UW
+};
+
+#define NSYSCALLS (sizeof(syscalls) / sizeof(syscalls[0]))
+
+#if OPT_SYSCALLSTAT
+/*
+ * Syscall statistics.
+ *
+ * Times are in nanoseconds, from gettime. The on-chip cycle counter
+ * would be cheaper to read, but it's per cpu, so a call that sleeps
+ * and wakes up elsewhere couldn't be timed, and the clock code
+ * restarts it at every hardclock, so a call spanning a tick would be
+ * mistimed anyway.
+ */
+#define SYSCALLSTAT_BUCKETS 32	/* Bucket n is [2^n, 2^(n+1)) ns */
+
+struct syscallstat {
+	unsigned ss_calls;		/* Number of calls */
+	unsigned ss_errors;		/* Number that failed */
+	uint64_t ss_nsecs;		/* Total time */
+	unsigned ss_hist[SYSCALLSTAT_BUCKETS];
+};
+
+static struct syscallstat syscallstats[NSYSCALLS];
+static struct spinlock syscallstat_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Record a call to CALLNO that returned ERR, having started at time
+ * SECS1.NSECS1.
+ */
+static
+void
+syscallstat_record(int callno, int err, time_t secs1, uint32_t nsecs1)
+{
+	struct syscallstat *ss;
+	time_t secs2;
+	uint32_t nsecs2;
+	uint64_t nsecs;
+	unsigned bucket;
+
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+	nsecs = (uint64_t)secs2 * 1000000000 + nsecs2;
+	for (bucket = 0; bucket < SYSCALLSTAT_BUCKETS-1 &&
+		     (nsecs >> (bucket+1)) != 0; bucket++) {
+		/* nothing */
+	}
+
+	ss = &syscallstats[callno];
+	spinlock_acquire(&syscallstat_lock);
+	ss->ss_calls++;
+	if (err) {
+		ss->ss_errors++;
+	}
+	ss->ss_nsecs += nsecs;
+	ss->ss_hist[bucket]++;
+	spinlock_release(&syscallstat_lock);
+}
+
+/*
+ * Print the counts and histograms of the calls that have been made.
+ * _exit and thread_exit don't return, so never show up.
+ */
+void
+syscallstat_dump(void)
+{
+	struct syscallstat ss;
+	unsigned i, b;
+
+	for (i=0; i<NSYSCALLS; i++) {
+		spinlock_acquire(&syscallstat_lock);
+		ss = syscallstats[i];
+		spinlock_release(&syscallstat_lock);
+
+		if (ss.ss_calls == 0) {
+			continue;
+		}
+		kprintf("%-16s %u calls, %u errors, mean %llu ns\n",
+			syscalls[i].sd_name, ss.ss_calls, ss.ss_errors,
+			ss.ss_nsecs / ss.ss_calls);
+		for (b=0; b<SYSCALLSTAT_BUCKETS; b++) {
+			if (ss.ss_hist[b] != 0) {
+				kprintf("    %10u-%-10u %u\n",
+					b == 0 ? 0 : 1U << b,
+					(2U << b) - 1, ss.ss_hist[b]);
+			}
+		}
+	}
+}
+#endif /* OPT_SYSCALLSTAT */
+
 /*
  * System call dispatcher.
  *
@@ -75,6 +343,13 @@
  * values) further arguments must be fetched from the user-level
  * stack, starting at sp+16 to skip over the slots for the
  * registerized values, with copyin().
+ *
+ * Each system call has an entry in the syscalls[] table below, indexed
+ * by call number, giving its name and a handler that takes the
+ * arguments out of the trapframe and calls the sys_ function. With
+ * "options syscallstat", the dispatcher also counts the calls to each
+ * one and keeps a histogram of how long they take; the menu command
+ * "sc" prints them.
  */
 void
 syscall(struct trapframe *tf)
@@ -82,6 +357,10 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+#if OPT_SYSCALLSTAT
+	time_t startsecs;
+	uint32_t startnsecs;
+#endif
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -100,52 +379,20 @@ syscall(struct trapframe *tf)
 
 	retval = 0;
 
-	switch (callno) {
-	    case SYS_reboot:
-		err = sys_reboot(tf->tf_a0);
-		break;
-
-	    case SYS___time:
-		err = sys___time((userptr_t)tf->tf_a0,
-				 (userptr_t)tf->tf_a1);
-		break;
-#ifdef UW
-	case SYS_write:
-	  err = sys_write((int)tf->tf_a0,
-			  (userptr_t)tf->tf_a1,
-			  (int)tf->tf_a2,
-			  (int *)(&retval));
-	  break;
-	case SYS__exit:
-	  sys__exit((int)tf->tf_a0, __WEXITED);
-	  /* sys__exit does not return, execution should not get here */
-	  panic("unexpected return from sys__exit");
-	  break;
-	case SYS_getpid:
-	  err = sys_getpid((pid_t *)&retval);
-	  break;
-	case SYS_waitpid:
-	  err = sys_waitpid((pid_t)tf->tf_a0,
-			    (userptr_t)tf->tf_a1,
-			    (int)tf->tf_a2,
-			    (pid_t *)&retval);
-	  break;
-	case SYS_fork:
-	  err = sys_fork(tf, (pid_t *)(&retval));
-	break;
-	case SYS_execv:
-	  err = sys_execv((userptr_t) tf->tf_a0, (userptr_t) tf->tf_a1);
-	break;
-#endif // UW
-
-	    /* Add stuff here */
- 
-	default:
-	  kprintf("Unknown syscall %d\n", callno);
-	  err = ENOSYS;
-	  break;
+	if (callno < 0 || (unsigned)callno >= NSYSCALLS ||
+	    syscalls[callno].sd_handler == NULL) {
+		kprintf("Unknown syscall %d\n", callno);
+		err = ENOSYS;
+	}
+	else {
+#if OPT_SYSCALLSTAT
+		gettime(&startsecs, &startnsecs);
+#endif
+		err = syscalls[callno].sd_handler(tf, &retval);
+#if OPT_SYSCALLSTAT
+		syscallstat_record(callno, err, startsecs, startnsecs);
+#endif
 	}
-
 
 	if (err) {
 		/*
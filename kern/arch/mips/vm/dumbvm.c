@@ -37,6 +37,8 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <threadpool.h>
+#include <sharedpage.h>
 
 /*
  * Dumb MIPS-only "VM system" that is intended to only be just barely
@@ -48,6 +50,14 @@
 /* under dumbvm, always have 48k of user stack */
 #define DUMBVM_STACKPAGES    12
 
+/*
+ * Top of user thread stack N. Each stack is followed (downwards) by
+ * one unmapped page, so running off the bottom of one faults instead
+ * of landing in the next.
+ */
+#define DUMBVM_TSTACKTOP(n) \
+	(USERSTACK - (n) * (DUMBVM_STACKPAGES + 1) * PAGE_SIZE)
+
 /*
  * Wrap rma_stealmem in a spinlock.
  */
@@ -115,15 +125,18 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	uint32_t ehi, elo;
 	struct addrspace *as;
 	int spl;
+	bool readonly;
 
 	faultaddress &= PAGE_FRAME;
 
 	DEBUG(DB_VM, "dumbvm: fault: 0x%x\n", faultaddress);
 
+	curthread->t_ru.rc_faults++;
+
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		/* We always create pages read-write, so we can't get this */
-		panic("dumbvm: got VM_FAULT_READONLY\n");
+		/* Only the shared pages are read-only */
+		return EFAULT;
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -170,6 +183,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
 	stacktop = USERSTACK;
 
+	readonly = false;
 	if (faultaddress >= vbase1 && faultaddress < vtop1) {
 		paddr = (faultaddress - vbase1) + as->as_pbase1;
 	}
@@ -179,8 +193,30 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+	else if (faultaddress == SHAREDPAGE_ADDR) {
+		paddr = sharedpage_paddr();
+		readonly = true;
+	}
+	else if (faultaddress == SHAREDPAGE_PROCADDR) {
+		paddr = as->as_procpage;
+		readonly = true;
+	}
 	else {
-		return EFAULT;
+		paddr = 0;
+		for (i=1; i<AS_MAXSTACKS; i++) {
+			stacktop = DUMBVM_TSTACKTOP(i);
+			stackbase = stacktop - DUMBVM_STACKPAGES * PAGE_SIZE;
+			if (as->as_tstackpbase[i] != 0 &&
+			    faultaddress >= stackbase &&
+			    faultaddress < stacktop) {
+				paddr = (faultaddress - stackbase) +
+					as->as_tstackpbase[i];
+				break;
+			}
+		}
+		if (paddr == 0) {
+			return EFAULT;
+		}
 	}
 
 	/* make sure it's page-aligned */
@@ -195,7 +231,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 			continue;
 		}
 		ehi = faultaddress;
-		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
+		elo = paddr | TLBLO_VALID;
+		if (!readonly) {
+			elo |= TLBLO_DIRTY;
+		}
 		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
@@ -210,6 +249,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 struct addrspace *
 as_create(void)
 {
+	unsigned i;
 	struct addrspace *as = kmalloc(sizeof(struct addrspace));
 	if (as==NULL) {
 		return NULL;
@@ -222,6 +262,17 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
+	for (i=0; i<AS_MAXSTACKS; i++) {
+		as->as_tstackpbase[i] = 0;
+	}
+
+	/* The pid gets filled in by as_activate */
+	as->as_procpage = getppages(1);
+	if (as->as_procpage == 0) {
+		kfree(as);
+		return NULL;
+	}
+	bzero((void *)PADDR_TO_KVADDR(as->as_procpage), PAGE_SIZE);
 
 	return as;
 }
@@ -237,6 +288,7 @@ as_activate(void)
 {
 	int i, spl;
 	struct addrspace *as;
+	struct sharedpage_proc *spp;
 
 	as = curproc_getas();
 #ifdef UW
@@ -246,6 +298,11 @@ as_activate(void)
 		return;
 	}
 
+	spp = (struct sharedpage_proc *)PADDR_TO_KVADDR(as->as_procpage);
+	if (spp->spp_pid != curproc->pid) {
+		spp->spp_pid = curproc->pid;
+	}
+
 	/* Disable interrupts on this CPU while frobbing the TLB. */
 	spl = splhigh();
 
@@ -305,7 +362,7 @@ static
 void
 as_zero_region(paddr_t paddr, unsigned npages)
 {
-	bzero((void *)PADDR_TO_KVADDR(paddr), npages * PAGE_SIZE);
+	parallel_bzero((void *)PADDR_TO_KVADDR(paddr), npages * PAGE_SIZE);
 }
 
 int
@@ -353,10 +410,35 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+/*
+ * Stacks for extra user threads. The memory for stack N is kept once
+ * allocated (dumbvm never frees anything anyway) and reused by the
+ * next thread to get the same number.
+ */
+int
+as_define_threadstack(struct addrspace *as, unsigned n, vaddr_t *stackptr)
+{
+	if (n < 1 || n >= AS_MAXSTACKS) {
+		return EINVAL;
+	}
+
+	if (as->as_tstackpbase[n] == 0) {
+		as->as_tstackpbase[n] = getppages(DUMBVM_STACKPAGES);
+		if (as->as_tstackpbase[n] == 0) {
+			return ENOMEM;
+		}
+		as_zero_region(as->as_tstackpbase[n], DUMBVM_STACKPAGES);
+	}
+
+	*stackptr = DUMBVM_TSTACKTOP(n);
+	return 0;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *new;
+	unsigned i;
 
 	new = as_create();
 	if (new==NULL) {
@@ -389,6 +471,20 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	memmove((void *)PADDR_TO_KVADDR(new->as_stackpbase),
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
+
+	for (i=1; i<AS_MAXSTACKS; i++) {
+		if (old->as_tstackpbase[i] == 0) {
+			continue;
+		}
+		new->as_tstackpbase[i] = getppages(DUMBVM_STACKPAGES);
+		if (new->as_tstackpbase[i] == 0) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		memmove((void *)PADDR_TO_KVADDR(new->as_tstackpbase[i]),
+			(const void *)PADDR_TO_KVADDR(old->as_tstackpbase[i]),
+			DUMBVM_STACKPAGES*PAGE_SIZE);
+	}
 	
 	*ret = new;
 	return 0;
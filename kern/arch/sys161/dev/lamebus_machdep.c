@@ -73,6 +73,63 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+static
+uint32_t
+mips_timer_count(void)
+{
+	uint32_t count;
+
+	/* $9 == c0_count */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
+/*
+ * Make the timer go off INTERVAL cycles from now. The interrupt
+ * handler below just writes the period, which works only if writing
+ * c0_compare also restarts c0_count from zero. Don't count on that
+ * here: after the tick has been off for a long time c0_count can be
+ * anywhere, and a compare value it has already passed wouldn't come
+ * round again until the counter wraps. So set compare relative to the
+ * current count, and if the write turns out to have reset the count,
+ * fall back to the plain interval.
+ */
+static
+void
+mips_timer_arm(uint32_t interval)
+{
+	uint32_t now;
+
+	now = mips_timer_count();
+	mips_timer_set(now + interval);
+	if (mips_timer_count() < now) {
+		mips_timer_set(interval);
+	}
+}
+
+/*
+ * The most hardclock periods the on-chip timer can be set for.
+ */
+#define MIPS_TIMER_MAXTICKS (0xffffffffU / (CPU_FREQUENCY / HZ))
+
+/*
+ * Delay the next hardclock on this cpu. The interrupt handler below
+ * goes back to one hardclock per period once it fires.
+ */
+void
+mainbus_settimer(unsigned ticks)
+{
+	if (ticks == 0 || ticks > MIPS_TIMER_MAXTICKS) {
+		ticks = MIPS_TIMER_MAXTICKS;
+	}
+	mips_timer_arm(ticks * (CPU_FREQUENCY / HZ));
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
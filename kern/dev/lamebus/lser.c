@@ -30,6 +30,8 @@
 #include <types.h>
 #include <lib.h>
 #include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
 #include <platform/bus.h>
 #include <lamebus/lser.h>
 #include "autoconf.h"
@@ -43,6 +45,44 @@
 #define LSER_IRQ_ENABLE  1
 #define LSER_IRQ_ACTIVE  2
 
+/*
+ * Pass received characters up to ls_input. Normally run as a task, so
+ * a burst of input costs one wakeup of the task thread rather than
+ * running the console code at interrupt level for every character.
+ * If two cpus get here at once the second leaves it to the first,
+ * which goes on until the buffer is empty, so ls_input is never
+ * called twice at once.
+ */
+static
+void
+lser_input(void *vsc, unsigned long junk)
+{
+	struct lser_softc *sc = vsc;
+	int ch;
+
+	(void)junk;
+
+	spinlock_acquire(&sc->ls_lock);
+	if (sc->ls_indraining) {
+		spinlock_release(&sc->ls_lock);
+		return;
+	}
+	sc->ls_indraining = true;
+	while (sc->ls_intail != sc->ls_inhead) {
+		ch = sc->ls_inbuf[sc->ls_intail % LSER_INBUF];
+		sc->ls_intail++;
+		spinlock_release(&sc->ls_lock);
+
+		if (sc->ls_input != NULL) {
+			sc->ls_input(sc->ls_devdata, ch);
+		}
+
+		spinlock_acquire(&sc->ls_lock);
+	}
+	sc->ls_indraining = false;
+	spinlock_release(&sc->ls_lock);
+}
+
 void
 lser_irq(void *vsc)
 {
@@ -68,7 +108,12 @@ lser_irq(void *vsc)
 		x = LSER_IRQ_ENABLE;
 		ch = bus_read_register(sc->ls_busdata, sc->ls_buspos,
 				       LSER_REG_CHAR);
-		got_a_read = true;
+		if (sc->ls_inhead - sc->ls_intail < LSER_INBUF) {
+			/* otherwise overflow; drop character */
+			sc->ls_inbuf[sc->ls_inhead % LSER_INBUF] = ch;
+			sc->ls_inhead++;
+			got_a_read = true;
+		}
 		bus_write_register(sc->ls_busdata, sc->ls_buspos, 
 				   LSER_REG_RIRQ, x);
 	}
@@ -78,8 +123,14 @@ lser_irq(void *vsc)
 	if (clear_to_write && sc->ls_start != NULL) {
 		sc->ls_start(sc->ls_devdata);
 	}
-	if (got_a_read && sc->ls_input != NULL) {
-		sc->ls_input(sc->ls_devdata, ch);
+	if (got_a_read) {
+		/* Until this cpu's task queue exists, do it here. */
+		if (curcpu->c_taskq != NULL) {
+			taskq_enqueue(&sc->ls_intask);
+		}
+		else {
+			lser_input(sc, 0);
+		}
 	}
 }
 
@@ -191,6 +242,9 @@ config_lser(struct lser_softc *sc, int lserno)
 
 	spinlock_init(&sc->ls_lock);
 	sc->ls_wbusy = false;
+	task_init(&sc->ls_intask, lser_input, sc, 0);
+	sc->ls_indraining = false;
+	sc->ls_inhead = sc->ls_intail = 0;
 
 	bus_write_register(sc->ls_busdata, sc->ls_buspos,
 			   LSER_REG_RIRQ, LSER_IRQ_ENABLE);
@@ -31,11 +31,20 @@
 #define _LAMEBUS_LSER_H_
 
 #include <spinlock.h>
+#include <taskq.h>
+
+/* Received characters not yet passed up; must be a power of 2 */
+#define LSER_INBUF 64
 
 struct lser_softc {
 	/* Initialized by config function */
-	struct spinlock ls_lock;    /* protects ls_wbusy and device regs */
+	struct spinlock ls_lock;    /* protects ls_wbusy, ls_in*, device regs */
 	volatile bool ls_wbusy;     /* true if write in progress */
+	struct task ls_intask;      /* passes received chars to ls_input */
+	bool ls_indraining;         /* true while someone is doing that */
+	unsigned ls_inhead;         /* next slot to receive into */
+	unsigned ls_intail;         /* next slot to pass up */
+	char ls_inbuf[LSER_INBUF];
 
 	/* Initialized by lower-level attachment function */
 	void *ls_busdata;
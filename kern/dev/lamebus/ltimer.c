@@ -46,11 +46,26 @@
 #define LT_REG_COUNT  16    /* Time for countdown timer (usec) */
 #define LT_REG_SPKR   20    /* Beep control */
 
-/* Granularity of countdown timer (usec) */
-#define LT_GRANULARITY   1000000
-
 static bool havetimerclock;
 
+/*
+ * Start the countdown timer to interrupt once after USECS microseconds.
+ * Writing the count register restarts it, so this replaces any
+ * countdown already in progress.
+ */
+static
+void
+ltimer_settimer(void *vlt, uint32_t usecs)
+{
+	struct ltimer_softc *lt = vlt;
+
+	if (usecs == 0) {
+		/* Zero would stop the timer rather than fire it. */
+		usecs = 1;
+	}
+	bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT, usecs);
+}
+
 /*
  * Setup routine called by autoconf stuff when an ltimer is found.
  */
@@ -85,16 +100,15 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 
 	/*
 	 * We do, however, use ltimer for the timer clock, since the
-	 * on-chip timer can't do that.
+	 * on-chip timer can't do that. It runs in one-shot mode and
+	 * is set for whenever the next callout is due.
 	 */
 	if (!havetimerclock) {
 		havetimerclock = true;
 		lt->lt_timerclock = 1;
 
-		/* Wire it to go off once every second. */
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 1);
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT,
-				   LT_GRANULARITY);
+		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 0);
+		timerclock_attach(lt, ltimer_settimer);
 	}
 	
 	return 0;
@@ -1034,6 +1034,7 @@ sfs_stat(struct vnode *v, struct stat *statbuf)
 	}
 
 	statbuf->st_size = sv->sv_i.sfi_size;
+	statbuf->st_ino = sv->sv_ino;
 
 	/* We don't support these yet; you get to implement them */
 	statbuf->st_nlink = 0;
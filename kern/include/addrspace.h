@@ -39,6 +39,14 @@
 #include "opt-dumbvm.h"
 
 struct vnode;
+struct fs;
+
+/*
+ * Number of user stacks an address space can have: the one made by
+ * as_define_stack, plus one for each extra user thread (see
+ * as_define_threadstack).
+ */
+#define AS_MAXSTACKS 8
 
 
 /* 
@@ -57,6 +65,8 @@ struct addrspace {
         paddr_t as_pbase2;
         size_t as_npages2;
         paddr_t as_stackpbase;
+        paddr_t as_tstackpbase[AS_MAXSTACKS]; /* Thread stacks; [0] unused */
+        paddr_t as_procpage;          /* struct sharedpage_proc */
 #else
         /* Put stuff here for your VM system */
 #endif
@@ -96,6 +106,11 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_define_threadstack - set up stack number N (1 to AS_MAXSTACKS-1)
+ *                for an extra user thread, if it isn't already, and
+ *                hand back its initial stack pointer. The stacks lie
+ *                below the main one, with unmapped gaps between.
  */
 
 struct addrspace *as_create(void);
@@ -112,16 +127,29 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_threadstack(struct addrspace *as, unsigned n,
+                                        vaddr_t *initstackptr);
 
 
 /*
  * Functions in loadelf.c
  *    load_elf - load an ELF user program executable into the current
  *               address space. Returns the entry point (initial PC)
- *               in the space pointed to by ENTRYPOINT.
+ *               in the space pointed to by ENTRYPOINT. The headers
+ *               of recently run programs are cached.
+ *
+ *    elfcache_vnodegone - called when a vnode that has been written
+ *               to is reclaimed.
+ *
+ *    elfcache_fsgone - called when a filesystem is unmounted.
+ *
+ *    elfcache_printstats - print the header cache's hit rate.
  */
 
 int load_elf(struct vnode *v, vaddr_t *entrypoint);
+void elfcache_vnodegone(struct vnode *v);
+void elfcache_fsgone(struct fs *fs);
+void elfcache_printstats(void);
 
 
 #endif /* _ADDRSPACE_H_ */
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _CALLOUT_H_
+#define _CALLOUT_H_
+
+/*
+ * Callouts: functions to be called at a given point in the future.
+ *
+ * Callouts are kept in a hierarchical timing wheel with a resolution
+ * of CALLOUT_USECS microseconds, finer than the hardclock period. The
+ * wheel is advanced from timerclock(), which the timer device calls
+ * when the next callout is due rather than at a fixed rate.
+ *
+ * The function runs in the task queue thread (see taskq.h) of
+ * whichever CPU took the timer interrupt. It must not sleep, as all
+ * the other callouts wait while it does. It may reschedule its own
+ * callout. Likewise, a task must not wait for a callout (e.g. with
+ * clocksleep): the callout may be queued behind it.
+ *
+ * The structure is made public so callouts do not have to be
+ * malloc'd; however, code that uses callouts should not look inside
+ * the structure directly but always use the callout functions.
+ */
+
+/* Resolution of the wheel, in microseconds. */
+#define CALLOUT_USECS	1000
+
+struct callout {
+	struct callout *co_next;	/* Links for the wheel slot */
+	struct callout *co_prev;
+	uint64_t co_expires;		/* Due time, in wheel ticks */
+	bool co_pending;		/* True if on the wheel */
+	void (*co_func)(void *);	/* Function to call */
+	void *co_arg;			/* Argument to pass it */
+};
+
+/*
+ * Callout functions.
+ *
+ * init		Initialize a callout to call FUNC(ARG). Not yet pending.
+ * reset	Schedule the callout to run SECS seconds and NSECS
+ *		nanoseconds from now. If already pending, it is
+ *		rescheduled.
+ * stop		Cancel the callout. Returns true if it was pending and
+ *		now will not run; false if it was not pending, which
+ *		includes the case where it is running right now on
+ *		another CPU. (If the caller needs to know the function
+ *		has finished, the function must tell it.)
+ * pending	Return true if the callout is scheduled and hasn't run.
+ *
+ * None of these may be called before callout_bootstrap().
+ */
+void callout_init(struct callout *co, void (*func)(void *), void *arg);
+void callout_reset(struct callout *co, time_t secs, uint32_t nsecs);
+bool callout_stop(struct callout *co);
+bool callout_pending(struct callout *co);
+
+/* Call once during system startup to set up the wheel. */
+void callout_bootstrap(void);
+
+/* Run whatever is due. Called from timerclock()'s task. */
+void callout_run(void);
+
+
+#endif /* _CALLOUT_H_ */
@@ -32,14 +32,17 @@
 
 #include "opt-synchprobs.h"
 
+struct thread;
+
 /*
  * Time-related definitions.
  *
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU by the timer device at times
+ * requested with timerclock_set(); it runs the callouts (see
+ * callout.h). The device registers itself with timerclock_attach().
  *
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
@@ -60,6 +63,26 @@ void hardclock_bootstrap(void);
 
 void hardclock(void);
 void timerclock(void);
+void timerclock_attach(void *devdata,
+		       void (*settimer)(void *devdata, uint32_t usecs));
+void timerclock_set(uint32_t usecs);
+
+/*
+ * hardclock_stop() switches off hardclock on the current CPU when it
+ * has no other thread to switch to; hardclock_start() switches it
+ * back on. Interrupts must be off; hardclock_stop() also requires the
+ * CPU's run queue lock.
+ */
+void hardclock_stop(void);
+void hardclock_start(void);
+
+/*
+ * hardclock charges each tick to the thread it interrupts. While the
+ * tick is off, the time is charged instead to the thread running on
+ * the CPU; the scheduler calls hardclock_setowner() when that changes.
+ * NULL means the CPU is idle. Interrupts must be off.
+ */
+void hardclock_setowner(struct thread *t);
 
 void gettime(time_t *seconds, uint32_t *nanoseconds);
 
@@ -70,8 +93,11 @@ void getinterval(time_t secs1, uint32_t nsecs,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ * clocknanosleep() is the same with a finer resolution, like
+ * nanosleep(2); the time is rounded up to the callout tick.
  */
 void clocksleep(int seconds);
+void clocknanosleep(time_t secs, uint32_t nsecs);
 
 
 #endif /* _CLOCK_H_ */
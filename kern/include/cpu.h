@@ -60,12 +60,25 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	time_t c_tickstop_secs;		/* When hardclock was switched off */
+	uint32_t c_tickstop_nsecs;
+	struct thread *c_tickowner;	/* Charged for time while it's off */
+	time_t c_tickcharged_secs;	/* c_tickowner charged up to here */
+	uint32_t c_tickcharged_nsecs;
+	struct threadlist c_threadcache; /* Dead threads kept for reuse */
+	unsigned c_threadcache_hits;	/* thread_fork reused one */
+	unsigned c_threadcache_misses;	/* thread_fork had to kmalloc */
+	struct taskq *c_taskq;		/* Deferred work; see taskq.h */
 
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the runqueue lock.
+	 *
+	 * c_tickstopped is only ever changed by this cpu. It is set
+	 * with the runqueue lock held but may be cleared without it.
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
+	bool c_tickstopped;		/* True if hardclock is switched off */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
 
@@ -109,6 +122,12 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Return the number of cpus. Only meaningful once mainbus_bootstrap
+ * has found them all.
+ */
+unsigned cpu_count(void);
+
 /*
  * Return a string describing the CPU type.
  */
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2004, 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SHAREDPAGE_H_
+#define _KERN_SHAREDPAGE_H_
+
+/*
+ * Pages of kernel data mapped read-only into every process, so that
+ * libc can answer getpid() and time() with a memory load instead of
+ * a system call.
+ *
+ * The first page is the same for everyone. The clock in it is the
+ * time of day as of the last update, and never goes backwards. Every
+ * cpu whose tick is running updates it at each hardclock, so while
+ * sp_tickstopped is less than sp_ncpus it is good to 1/HZ. When every
+ * cpu has its tick switched off (each is idle or running just one
+ * thread) nothing updates it regularly, and time() makes the system
+ * call instead. All of it is rewritten under a sequence number that
+ * is odd while a write is in progress; readers read the sequence
+ * number, then the rest, then the sequence number again, and start
+ * over if it was odd or has changed.
+ *
+ * The second page belongs to the process.
+ */
+
+#define SHAREDPAGE_ADDR		0x7ff00000	/* Shared by all processes */
+#define SHAREDPAGE_PROCADDR	0x7ff01000	/* Per-process */
+
+struct sharedpage {
+	volatile __u32 sp_seq;		/* Odd while the page is changing */
+	volatile __time_t sp_secs;	/* Time of the last update */
+	volatile __u32 sp_nsecs;
+	volatile __u32 sp_ncpus;	/* Number of cpus */
+	volatile __u32 sp_tickstopped;	/* Cpus with their tick off */
+};
+
+struct sharedpage_proc {
+	volatile __pid_t spp_pid;	/* getpid() */
+};
+
+
+#endif /* _KERN_SHAREDPAGE_H_ */
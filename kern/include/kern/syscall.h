@@ -54,6 +54,7 @@
 #define SYS_waitpid      4
 #define SYS_getpid       5
 #define SYS_getppid      6
+#define SYS_spawn        126
 //                              (virtual memory)
 #define SYS_sbrk         7
 #define SYS_mmap         8
@@ -86,7 +87,7 @@
 //#define SYS_sigaltstack 33
 //                              (resource tracking and usage)
 //#define SYS_wait4      34
-//#define SYS_getrusage  35
+#define SYS_getrusage    35
 //                              (resource limits)
 //#define SYS_getrlimit  36
 //#define SYS_setrlimit  37
@@ -197,6 +198,13 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Threads --
+#define SYS___thread_create 121
+#define SYS_thread_join  122
+#define SYS_thread_exit  123
+#define SYS_futex_wait   124
+#define SYS_futex_wake   125
+
 /*CALLEND*/
 
 
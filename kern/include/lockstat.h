@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock statistics.
+ *
+ * With "options lockstat" in the kernel config, every spinlock, lock,
+ * semaphore and CV keeps counts of acquires and contended acquires,
+ * the total time spent spinning and sleeping to get it, and (for
+ * spinlocks and locks) the longest time it was held. The menu command
+ * "ls" prints the locks with the most time spent waiting.
+ *
+ * Spinlocks have no names; they are reported by the file and line of
+ * their spinlock_init call or SPINLOCK_INITIALIZER.
+ *
+ * Statistics are kept per lock instance, by address, in a fixed-size
+ * table so that recording never needs to allocate memory or take a
+ * spinlock. When a lock is destroyed its counts are added to one
+ * entry for all destroyed locks of the same kind and name, and its
+ * own entry is reused, so the table shows history without filling up
+ * as locks come and go. If it does fill up, new locks aren't recorded.
+ *
+ * This is expensive - every spinlock acquire reads the clock twice
+ * and takes a global lock - so it is for finding hot locks, not for
+ * production kernels.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+/* Kinds of lock */
+#define LOCKSTAT_SPIN	0
+#define LOCKSTAT_LOCK	1
+#define LOCKSTAT_SEM	2
+#define LOCKSTAT_CV	3
+
+/*
+ * Functions.
+ *
+ * lockstat_bootstrap	Start recording. Call once the clock is attached.
+ * lockstat_now		Current time in nanoseconds, or 0 if not recording.
+ * lockstat_acquired	Record an acquire of LOCK, and the time spent
+ *			spinning and sleeping to get it. CONTENDED should
+ *			be true if it couldn't be had immediately. NAME
+ *			may be NULL (for spinlocks).
+ * lockstat_released	Record how long LOCK was held.
+ * lockstat_destroyed	LOCK is going away; fold its counts into the
+ *			history for its name and free its entry.
+ * lockstat_dump	Print the MAX locks with the most wait time.
+ */
+void lockstat_bootstrap(void);
+uint64_t lockstat_now(void);
+void lockstat_acquired(const void *lock, unsigned kind, const char *name,
+		       bool contended, uint64_t spinns, uint64_t sleepns);
+void lockstat_released(const void *lock, uint64_t holdns);
+void lockstat_destroyed(const void *lock);
+void lockstat_dump(unsigned max);
+
+#endif /* OPT_LOCKSTAT */
+
+
+#endif /* _LOCKSTAT_H_ */
@@ -55,6 +55,13 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Arrange for the next hardclock on the current CPU to happen TICKS
+ * hardclock periods from now. 0 means as far in the future as the
+ * hardware allows. Periodic hardclocks resume afterwards.
+ */
+void mainbus_settimer(unsigned ticks);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
@@ -41,24 +41,39 @@
 #include <synch.h>
 #include <limits.h>
 #include <opt-A2.h>
-#include <array.h>
 
 
 struct addrspace;
 struct vnode;
+struct rusage;
 //struct fdesc;
 #ifdef UW
 struct semaphore;
 #endif // UW
 struct proc;
 
-// Code for creating a list of processes
-#ifndef PROCINLINE
-#define PROCINLINE INLINE
-#endif
+// A list of processes, linked through p_sibnext/p_sibprev
+struct proclist {
+	struct proc * pl_head;
+	struct proc * pl_tail;
+};
+
+/*
+ * User threads. A process can have up to PROC_MAXTHREADS of them;
+ * the first is started by runprogram or fork and the others by the
+ * __thread_create syscall. A thread's id is its index in p_uthreads
+ * and also the number of its user stack (see as_define_threadstack),
+ * the first thread using the main stack. An entry stays in use after
+ * its thread exits until someone collects it with thread_join.
+ */
+#define PROC_MAXTHREADS 8
 
-DECLARRAY(proc);
-DEFARRAY(proc, PROCINLINE);
+struct uthread {
+	bool ut_used;		/* Thread exists or hasn't been joined */
+	bool ut_exited;		/* Thread has exited */
+	bool ut_joining;	/* Someone's waiting in thread_join */
+	int ut_status;		/* Exit status, once exited */
+};
 
 
 
@@ -78,19 +93,41 @@ struct proc {
 	
 	const pid_t pid; /* the ID of this process */
 
+	// The parent/child fields below are all protected by the process
+	// tree lock in proc.c.
+
 	// The exit status of this processor
 	volatile int proc_exit_status;
 	// Predicate to determine if this process has already exited
 	volatile bool proc_exited;
-	// Predicate to determine if the parent of this process has exited
-	volatile bool proc_parent_exited;
-	// lock used for the children array of this process for mutex
-	struct lock * proc_children_lock;
-	// lock and cv for when the process waits for child to exit (waitpid)
-	struct lock * proc_exit_lock;
-	struct cv * proc_exit_cv;
-	// List of chilren
-	struct procarray proc_children;
+	// The parent; NULL once it has exited, or if it's the kernel,
+	// in which case no one will wait for this process
+	struct proc * p_parent;
+	// Children still running, and children that have exited but haven't
+	// been waited for yet (zombies), in the order they exited. Each child
+	// is on one of the two lists, linked through p_sibnext/p_sibprev.
+	struct proclist proc_children;
+	struct proclist p_zombies;
+	struct proc * p_sibnext;
+	struct proc * p_sibprev;
+	// cv for when the process waits for a child to exit (waitpid)
+	struct cv * p_waitcv;
+
+	// User threads. p_threadlock protects the rest; p_threadcv is
+	// signalled whenever a thread exits.
+	struct lock * p_threadlock;
+	struct cv * p_threadcv;
+	struct uthread p_uthreads[PROC_MAXTHREADS];
+	// Threads that haven't exited yet
+	unsigned p_nuthreads;
+	// Set once one thread calls _exit; the others exit when they
+	// next come into the kernel
+	volatile bool p_exiting;
+
+	// Resource usage of the threads that have left the process, and
+	// of the children that have been waited for. Protected by p_lock.
+	struct rucounts p_ru;
+	struct rucounts p_cru;
 	
 		
 		
@@ -109,18 +146,26 @@ struct proc {
 /* This is the process structure for the kernel and for kernel-only threads. */
 extern struct proc *kproc;
 
-// bitmap used for process ids
-struct bitmap * proc_id_map;
-// spinlock for the bitmap
-struct spinlock proc_id_map_spinlock;
-
 void proc_clear_as(struct proc *proc);
 
-// Set the exit status of the proc to exitcode
-void proc_set_exit_status ( struct proc *proc, const int exitcode, const int type);
+// Set the exit status of the proc to exitcode, and put it on its parent's
+// list of zombies. Returns false if there's no parent to wait for it, in
+// which case the caller should destroy it.
+bool proc_set_exit_status ( struct proc *proc, const int exitcode, const int type);
+
+// Waits for the child of the process proc that has the id pid, or for any
+// child if pid is -1, to exit, and then reaps it: returns its pid and exit
+// status and destroys it. With nohang, returns pid 0 if none has exited.
+int proc_wait_child(struct proc *proc, pid_t pid, bool nohang,
+		    int *status, pid_t *childpid);
+
+// Fills in ru with the resource usage of the process proc (who is
+// RUSAGE_SELF) or of its children that have been waited for
+// (RUSAGE_CHILDREN).
+int proc_getrusage(struct proc *proc, int who, struct rusage *ru);
 
-// Finds any child of the process proc that has the id pid
-struct proc * proc_find_child(struct proc * proc, const int pid);
+// Gets any thread of the (exiting) process proc out of proc_wait_child
+void proc_wait_interrupt(struct proc *proc);
 
 // Notifies the children of the process proc that their parent has exited
 void proc_exited_signal ( struct proc * proc);
@@ -162,11 +207,11 @@ struct addrspace *curproc_getas(void);
 /* Change the address space of the current process, and return the old one. */
 struct addrspace *curproc_setas(struct addrspace *);
 
-// Assigns the next available pid to the ptr that points to the pid field of the proc
-int proc_assign_pid(int * proc_pid_addr_ptr);
+// Assigns the next available pid to the proc, and enters it in the pid table
+int proc_assign_pid(struct proc * proc);
 
-// When a process exits, and no one is interested in the proccess anymore, sets the pid
-// to be reused.
+// When a process exits, and no one is interested in the proccess anymore, takes
+// it out of the pid table so the pid can be reused.
 void proc_set_pid_unused(const int pid);
 
 
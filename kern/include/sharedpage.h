@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2004, 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SHAREDPAGE_H_
+#define _SHAREDPAGE_H_
+
+/*
+ * Kernel side of the page of kernel data that every process sees;
+ * see <kern/sharedpage.h>.
+ *
+ *    sharedpage_bootstrap   - allocate the page. Call once the cpus
+ *                             have been found.
+ *    sharedpage_paddr       - physical address of the page, for the
+ *                             VM system to map.
+ *    sharedpage_tick        - bring the clock up to date. Called by
+ *                             hardclock, and wherever else it's handy.
+ *    sharedpage_tickstopped - note that the current cpu has stopped
+ *                             (true) or restarted (false) its tick.
+ *                             Also brings the clock up to date.
+ *
+ * The last two may be called from interrupt handlers and with
+ * spinlocks held.
+ */
+
+#include <kern/sharedpage.h>
+
+void sharedpage_bootstrap(void);
+paddr_t sharedpage_paddr(void);
+void sharedpage_tick(void);
+void sharedpage_tickstopped(bool stopped);
+
+
+#endif /* _SHAREDPAGE_H_ */
@@ -36,6 +36,7 @@
  */
 
 #include <cdefs.h>
+#include "opt-lockstat.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -50,19 +51,46 @@
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * This is a ticket lock: each CPU wanting the lock takes a number
+ * from lk_next and waits for lk_serving to reach it. So CPUs get the
+ * lock in the order they asked for it, and releasing the lock only
+ * writes one word, which the waiters merely read.
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
 struct spinlock {
-	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
+	volatile spinlock_data_t lk_next; /* Next ticket to hand out. */
+	volatile spinlock_data_t lk_serving; /* Ticket that holds the lock. */
 	struct cpu *lk_holder;		/* CPU holding this lock. */
+#if OPT_LOCKSTAT
+	uint64_t lk_acquired;		/* When it was acquired (lockstat) */
+	const char *lk_name;		/* Where it was set up (lockstat) */
+#endif
 };
 
+#if OPT_LOCKSTAT
+/*
+ * Spinlocks have no names, so lockstat calls them by the file and
+ * line where they were initialized.
+ */
+#define SPINLOCK_STR(x)		SPINLOCK_STR2(x)
+#define SPINLOCK_STR2(x)	#x
+#define SPINLOCK_SITE		__FILE__ ":" SPINLOCK_STR(__LINE__)
+#endif
+
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_LOCKSTAT
+#define SPINLOCK_INITIALIZER	\
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL, 0, \
+	  SPINLOCK_SITE }
+#else
+#define SPINLOCK_INITIALIZER	\
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL }
+#endif
 
 /*
  * Spinlock functions.
@@ -71,6 +99,7 @@ struct spinlock {
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
+ *		Waiters get the lock in first-come first-served order.
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
@@ -78,6 +107,10 @@ struct spinlock {
 
 void spinlock_init(struct spinlock *lk);
 void spinlock_cleanup(struct spinlock *lk);
+#if OPT_LOCKSTAT
+void spinlock_init_at(struct spinlock *lk, const char *site);
+#define spinlock_init(lk) spinlock_init_at(lk, SPINLOCK_SITE)
+#endif
 
 void spinlock_acquire(struct spinlock *lk);
 void spinlock_release(struct spinlock *lk);
@@ -36,6 +36,8 @@
 
 
 #include <spinlock.h>
+#include <thread.h>		/* for NPRI */
+#include "opt-lockstat.h"
 
 /*
  * Dijkstra-style semaphore.
@@ -79,7 +81,12 @@ struct lock {
 
         struct wchan* lk_wchan ;
         struct spinlock lk_lock ;
-        struct thread volatile* lk_owner ;
+        struct thread volatile* volatile lk_owner ;
+        unsigned lk_waiters [ NPRI ] ;  // sleepers at each priority
+        struct lock * lk_nextheld ;     // next lock held by lk_owner
+#if OPT_LOCKSTAT
+        uint64_t lk_acquired ;  // when it was acquired (lockstat)
+#endif
 
         // End of added things.
 
@@ -94,18 +101,32 @@ void lock_acquire(struct lock *);
 /*
  * Operations:
  *    lock_acquire - Get the lock. Only one thread can hold the lock at the
- *                   same time.
+ *                   same time. If the holder is running on another cpu,
+ *                   spin for a while first in the hope it lets go soon,
+ *                   rather than going straight to sleep.
  *    lock_release - Free the lock. Only the thread holding the lock may do
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock; 
  *                   false otherwise.
  *
+ * Locks do priority inheritance: while a thread sleeps in lock_acquire,
+ * the holder runs at no less than the sleeper's priority, and so on
+ * down the chain if the holder is itself waiting for another lock.
+ * lock_release puts the holder's priority back to what the locks it
+ * still holds call for.
+ *
  * These operations must be atomic. You get to write them.
  */
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 void lock_destroy(struct lock *);
 
+/*
+ * Recompute the current thread's effective priority after its base
+ * priority has changed. Used by thread_setpriority.
+ */
+void lock_inherit_update(void);
+
 
 /*
  * Condition variable.
@@ -160,4 +181,53 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Writers take precedence: once a writer is waiting, new readers
+ * wait behind it, so a steady stream of readers can't starve it out.
+ * Taking or dropping a read lock that no writer is involved with
+ * touches only the spinlock.
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+
+struct rwlock {
+        char *rwlock_name;
+        struct spinlock rw_lock;
+        struct wchan *rw_readwchan;	/* Readers waiting */
+        struct wchan *rw_writewchan;	/* Writers waiting */
+        volatile unsigned rw_readers;	/* Readers holding the lock */
+        volatile unsigned rw_writerswaiting;
+        struct thread *volatile rw_writer; /* Writer holding the lock */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading. Other threads
+ *                           may also hold it for reading.
+ *    rwlock_release_read  - Free a read lock.
+ *    rwlock_acquire_write - Get the lock for writing. Only one thread
+ *                           can hold the lock for writing, and no
+ *                           threads can hold it for reading then.
+ *    rwlock_release_write - Free the write lock.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                           the lock for writing. (There is no read
+ *                           equivalent; readers aren't tracked.)
+ *
+ * None of these may be called from an interrupt handler, and the
+ * lock isn't recursive.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
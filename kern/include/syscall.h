@@ -39,6 +39,12 @@ struct trapframe; /* from <machine/trapframe.h> */
 
 void syscall(struct trapframe *tf);
 
+/*
+ * Print the per-syscall counts and latency histograms. Only with
+ * "options syscallstat".
+ */
+void syscallstat_dump(void);
+
 /*
  * Support functions.
  */
@@ -50,6 +56,32 @@ void enter_forked_process(struct trapframe *tf);
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 		       vaddr_t entrypoint);
 
+/* Enter user mode in a new user thread. Does not return. */
+void enter_new_thread(vaddr_t entrypoint, vaddr_t a0, vaddr_t a1,
+		      vaddr_t stackptr);
+
+/* User thread support for _exit and the trap code; see thread_syscalls.c */
+void uthread_exitall(void);
+void uthread_exiting(void);
+
+/*
+ * Argument vectors for execv and spawn; see argv.c. argbuf_copyin
+ * copies in a user argv, argbuf_copyout puts it on a new program's
+ * stack, and argbuf_cleanup frees it.
+ */
+struct argbuf {
+	char *ab_buf;		/* The strings, packed end to end */
+	size_t ab_len;		/* Bytes of ab_buf in use */
+	int ab_argc;		/* Number of strings */
+};
+int argbuf_copyin(struct argbuf *ab, userptr_t uargv);
+int argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *uargv);
+void argbuf_cleanup(struct argbuf *ab);
+
+/* Futex table; see futex_syscalls.c */
+void futex_bootstrap(void);
+void futex_exiting(void);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -57,6 +89,13 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(userptr_t req, userptr_t rem);
+int sys___thread_create(userptr_t start, userptr_t func, userptr_t arg,
+			int *retval);
+int sys_thread_join(int tid, userptr_t status);
+void sys_thread_exit(int status);
+int sys_futex_wait(userptr_t addr, int expected);
+int sys_futex_wake(userptr_t addr, int n, int *retval);
 
 #ifdef UW
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
@@ -65,6 +104,8 @@ int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 int sys_fork(struct trapframe * tf, pid_t *retval);
 int sys_execv(userptr_t progname, userptr_t args);
+int sys_spawn(userptr_t progname, userptr_t args, pid_t *retval);
+int sys_getrusage(int who, userptr_t usage);
 #endif // UW
 
 #endif /* _SYSCALL_H_ */
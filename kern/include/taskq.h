@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _TASKQ_H_
+#define _TASKQ_H_
+
+/*
+ * Task queues: deferred work for interrupt handlers.
+ *
+ * An interrupt handler that has more to do than it should do at
+ * interrupt level can queue a task instead. Each cpu has a queue and
+ * a kernel thread, pinned to that cpu and running at PRI_MAX, that
+ * runs the tasks queued there in order. The thread is only woken if
+ * it was asleep, so a burst of interrupts costs one wakeup and the
+ * tasks are run in a batch.
+ *
+ * Queueing a task that is already queued and hasn't started to run
+ * does nothing; the function runs once for both. Once it has started
+ * the task may be queued again. So a driver can queue the same task
+ * for every completion and have the function deal with everything
+ * that has completed by the time it runs.
+ *
+ * Task functions run in thread context and may sleep, but anything
+ * else queued on the same cpu waits while they do. That includes the
+ * callout wheel, which timerclock() turns from a task, and the input
+ * lser passes up to the console from one.
+ *
+ * The structure is made public so tasks do not have to be malloc'd;
+ * however, code that uses tasks should not look inside the structure
+ * directly but always use the task functions.
+ */
+
+#include <spinlock.h>
+
+struct task {
+	struct task *tk_next;		/* Link for the queue */
+	volatile spinlock_data_t tk_queued; /* Nonzero while queued */
+	void (*tk_func)(void *, unsigned long); /* Function to call */
+	void *tk_data1;			/* Arguments to pass it */
+	unsigned long tk_data2;
+};
+
+/*
+ * Task functions.
+ *
+ * task_init	Initialize a task to call FUNC(DATA1, DATA2).
+ * taskq_enqueue
+ *		Queue the task on the current cpu. Returns false if it
+ *		was already queued. May be called from an interrupt
+ *		handler, or with spinlocks held.
+ */
+void task_init(struct task *tk, void (*func)(void *, unsigned long),
+	       void *data1, unsigned long data2);
+bool taskq_enqueue(struct task *tk);
+
+/*
+ * Set up the current cpu's queue and start its thread. Called once on
+ * each cpu during startup.
+ */
+void taskq_startcpu(void);
+
+/* Print per-cpu counts of tasks run and of wakeups. */
+void taskq_printstats(void);
+
+
+#endif /* _TASKQ_H_ */
@@ -59,6 +59,12 @@ int threadtest3(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int lockbench(int, char **);
+int rwtest(int, char **);
+int spinlockbench(int, char **);
+int pitest(int, char **);
+int taskqtest(int, char **);
+int pzerobench(int, char **);
 
 #ifdef UW
 /* More thread and synchronization tests */
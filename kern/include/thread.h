@@ -64,6 +64,33 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/*
+ * Thread priorities. Higher numbers run first; threads of equal
+ * priority take turns.
+ */
+#define PRI_MIN		0
+#define PRI_DEFAULT	4
+#define PRI_MAX		7
+#define NPRI		(PRI_MAX + 1)
+
+struct lock;
+
+/*
+ * Resource usage counts. These are kept per thread so the thread can
+ * bump them without locking; proc_remthread adds them into the
+ * process's totals when the thread leaves the process. See
+ * proc_getrusage.
+ */
+struct rucounts {
+	unsigned rc_uticks;		/* hardclocks in user mode */
+	unsigned rc_sticks;		/* hardclocks in the kernel */
+	unsigned rc_nvcsw;		/* Times we slept or yielded */
+	unsigned rc_nivcsw;		/* Times we were preempted */
+	unsigned rc_faults;		/* VM faults */
+	uint64_t rc_inbytes;		/* Bytes read through the VFS */
+	uint64_t rc_outbytes;		/* Bytes written through the VFS */
+};
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -82,6 +109,8 @@ struct thread {
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	unsigned t_lastrun;		/* t_cpu's c_hardclocks at last run */
+	bool t_pinned;			/* Never move to another cpu */
 	struct proc *t_proc;		/* Process thread belongs to */
 
 	/*
@@ -98,6 +127,7 @@ struct thread {
 	 * rather than per-cpu or global?
 	 */
 	bool t_in_interrupt;		/* Are we in an interrupt? */
+	bool t_userintr;		/* Interrupt came from user mode */
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
@@ -105,6 +135,21 @@ struct thread {
 	 * Public fields
 	 */
 
+	unsigned t_migrations;		/* Times moved to a different CPU */
+	int t_tid;			/* User thread id within t_proc */
+	struct rucounts t_ru;		/* Resource usage; see above */
+
+	/*
+	 * Priority fields. t_pri is t_basepri, raised as needed by
+	 * priority inheritance while threads of higher priority wait
+	 * for locks this thread holds; see synch.c. Protected by the
+	 * lock code's internal spinlock.
+	 */
+	int t_basepri;			/* Priority set by thread_setpriority */
+	volatile int t_pri;		/* Effective priority */
+	struct lock *t_blockedon;	/* Lock we're sleeping on, if any */
+	struct lock *t_heldlocks;	/* Locks we hold, via lk_nextheld */
+
 	/* add more here as needed */
 };
 
@@ -144,6 +189,14 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but the new thread belongs to the kernel process
+ * and is pinned to the current cpu: the scheduler never moves it.
+ */
+int thread_fork_pinned(const char *name,
+                       void (*func)(void *, unsigned long),
+                       void *data1, unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -157,16 +210,34 @@ void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * The same, but called from an interrupt handler to take the cpu away
+ * from the current thread. Counted as an involuntary context switch.
+ */
+void thread_preempt(void);
+
+/*
+ * Set the current thread's priority (PRI_MIN to PRI_MAX). New threads
+ * start with the priority of the thread that forked them.
+ */
+void thread_setpriority(int pri);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
 void schedule(void);
 
 /*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
+ * Print per-CPU scheduler state, including the migration counts of
+ * the threads currently running or waiting to run.
+ */
+void thread_printstats(void);
+
+/*
+ * Print per-CPU hit rates of the cache of dead threads and stacks
+ * that thread_fork reuses.
  */
-void thread_consider_migration(void);
+void thread_cachestats(void);
 
 
 #endif /* _THREAD_H_ */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+/*
+ * Kernel thread pool.
+ *
+ * There is one pool thread per cpu, pinned there. parallel_for hands
+ * a loop to as many of them as are free and useful, works on it in
+ * the calling thread as well, and returns when every iteration has
+ * finished. Iterations are handed out one at a time, so uneven ones
+ * balance out; they may run in any order and on any cpu.
+ *
+ * FUNC may sleep and take locks, but must not wait for anything the
+ * caller holds, since the caller may be running iterations itself
+ * or waiting for them. If the pool can't be used (e.g. out of
+ * memory) the whole loop runs in the caller.
+ */
+
+void parallel_for(unsigned long n,
+		  void (*func)(void *data, unsigned long i), void *data);
+
+/*
+ * bzero, done with parallel_for in chunks of a few pages when the
+ * block is big enough for that to pay. Used for zeroing fresh user
+ * memory. Must be called from a context that can sleep.
+ */
+void parallel_bzero(void *block, size_t len);
+
+/*
+ * Start the current cpu's pool thread. Called once on each cpu during
+ * startup.
+ */
+void threadpool_startcpu(void);
+
+
+#endif /* _THREADPOOL_H_ */
@@ -50,10 +50,20 @@ struct stat;
  * vn_opencount is managed using VOP_INCOPEN and VOP_DECOPEN by
  * vfs_open() and vfs_close(). Code above the VFS layer should not
  * need to worry about it.
+ *
+ * vn_serial is different for every vnode ever initialized, so a vnode
+ * pointer and serial number together say which vnode this is even
+ * without holding a reference. vn_writegen starts at 0 and goes up
+ * after every VOP_WRITE and VOP_TRUNCATE, so anything remembered about
+ * the file's contents is out of date if it has changed since. (The
+ * exec cache in loadelf.c uses these; it's told when a vnode that has
+ * been written is cleaned up.)
  */
 struct vnode {
 	int vn_refcount;                /* Reference count */
 	int vn_opencount;
+	unsigned vn_serial;		/* Unique id */
+	volatile unsigned vn_writegen;	/* Bumped by write and truncate */
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
 
@@ -245,17 +255,17 @@ struct vnode_ops {
 #define VOP_CLOSE(vn)                   (__VOP(vn, close)(vn))
 #define VOP_RECLAIM(vn)                 (__VOP(vn, reclaim)(vn))
 
-#define VOP_READ(vn, uio)               (__VOP(vn, read)(vn, uio))
+#define VOP_READ(vn, uio)               vnode_read(vn, uio)
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
-#define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
+#define VOP_WRITE(vn, uio)              vnode_write(vn, uio)
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_TRYSEEK(vn, pos)            (__VOP(vn, tryseek)(vn, pos))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
-#define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
+#define VOP_TRUNCATE(vn, pos)           vnode_truncate(vn, pos)
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
@@ -274,6 +284,15 @@ struct vnode_ops {
  */
 void vnode_check(struct vnode *, const char *op);
 
+/*
+ * Read and write, which also count the bytes moved in the current
+ * thread's resource usage, and truncate. Write and truncate also bump
+ * vn_writegen.
+ */
+int vnode_read(struct vnode *, struct uio *);
+int vnode_write(struct vnode *, struct uio *);
+int vnode_truncate(struct vnode *, off_t);
+
 /*
  * Reference count manipulation (handled above filesystem level)
  */
@@ -81,5 +81,23 @@ void wchan_sleep(struct wchan *wc);
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+/*
+ * Wake up thread T if it is sleeping on the channel, and return true
+ * if it was. Unlike the above, the channel must be locked, and will
+ * have been *unlocked* upon return.
+ */
+struct thread;
+bool wchan_wakethread(struct wchan *wc, struct thread *t);
+
+/*
+ * Move one thread, or all threads, sleeping on FROM over to sleep on
+ * TO instead, without waking them up; they wake when TO is woken.
+ * transferone returns false if there was nobody to move. Neither
+ * queue should already be locked. Code that uses these for a given
+ * pair of channels must always pass them in the same order.
+ */
+bool wchan_transferone(struct wchan *from, struct wchan *to);
+void wchan_transferall(struct wchan *from, struct wchan *to);
+
 
 #endif /* _WCHAN_H_ */
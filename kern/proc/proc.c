@@ -42,9 +42,6 @@
  * process that will have more than one thread is the kernel process.
  */
 
-// For use for the proc array
-#define PROCINLINE
-
 #include <types.h>
 #include <proc.h>
 #include <current.h>
@@ -55,17 +52,38 @@
 #include <kern/fcntl.h>
 #include <limits.h>
 #include <syscall.h>
-#include <bitmap.h>
-#include <array.h>
 #include <kern/errno.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <clock.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
  */
 struct proc *kproc;
 
+/*
+ * The pid table: every process, from creation until proc_destroy,
+ * indexed by pid. Pids are handed out next-fit: the search for a free
+ * one starts just after the last pid handed out, so it normally finds
+ * one straight away, rather than rescanning the pids still in use at
+ * the bottom of the table every time. It also means a pid doesn't get
+ * reused until the others have come round.
+ */
+static struct proc **proc_table;
+static pid_t proc_nextpid;
+static struct spinlock proc_table_lock;
+
+/*
+ * The process tree lock: protects who is whose parent, the lists of
+ * children and zombies, and the exit status. One lock for the lot
+ * keeps a parent and child exiting at the same time from having to
+ * take each other's locks.
+ */
+static struct lock *proc_tree_lock;
+
 /*
  * Mechanism for making the kernel menu thread sleep while processes are running
  */
@@ -81,6 +99,61 @@ struct semaphore *no_proc_sem;
 
 
 
+/*
+ * Helpers for process lists. Call with the tree lock held.
+ */
+static
+void
+proclist_addtail(struct proclist *pl, struct proc *proc)
+{
+	proc->p_sibnext = NULL;
+	proc->p_sibprev = pl->pl_tail;
+	if (pl->pl_tail != NULL) {
+		pl->pl_tail->p_sibnext = proc;
+	}
+	else {
+		pl->pl_head = proc;
+	}
+	pl->pl_tail = proc;
+}
+
+static
+void
+proclist_remove(struct proclist *pl, struct proc *proc)
+{
+	if (proc->p_sibprev != NULL) {
+		proc->p_sibprev->p_sibnext = proc->p_sibnext;
+	}
+	else {
+		KASSERT(pl->pl_head == proc);
+		pl->pl_head = proc->p_sibnext;
+	}
+	if (proc->p_sibnext != NULL) {
+		proc->p_sibnext->p_sibprev = proc->p_sibprev;
+	}
+	else {
+		KASSERT(pl->pl_tail == proc);
+		pl->pl_tail = proc->p_sibprev;
+	}
+	proc->p_sibnext = proc->p_sibprev = NULL;
+}
+
+/*
+ * Add the resource usage counts in FROM to TO.
+ */
+static
+void
+rucounts_add(struct rucounts *to, const struct rucounts *from)
+{
+	to->rc_uticks += from->rc_uticks;
+	to->rc_sticks += from->rc_sticks;
+	to->rc_nvcsw += from->rc_nvcsw;
+	to->rc_nivcsw += from->rc_nivcsw;
+	to->rc_faults += from->rc_faults;
+	to->rc_inbytes += from->rc_inbytes;
+	to->rc_outbytes += from->rc_outbytes;
+}
+
 /*
  * Create a proc structure.
  */
@@ -100,38 +173,36 @@ proc_create(const char *name)
 		return NULL;
 	}
 
-	// Initialize the proc_exit_lock
-	proc->proc_exit_lock = lock_create(name);
-	if (proc->proc_exit_lock == NULL) {
+	// Initialize the condition variable that will be needed for waitpid
+	proc->p_waitcv = cv_create(name);
+	if (proc->p_waitcv == NULL) {
 		kfree(proc->p_name);
 		kfree(proc);
 		return NULL;
 	}
 
-	// Initialize the lock for the children array
- 	proc->proc_children_lock = lock_create(name);
- 	if (proc->proc_children_lock == NULL) {
-		 lock_destroy(proc->proc_exit_lock);
-		 kfree(proc->p_name);
-		 kfree(proc);
-		 return NULL;
+	// Initialize the lock and cv for user threads
+	proc->p_threadlock = lock_create(name);
+	if (proc->p_threadlock == NULL) {
+		cv_destroy(proc->p_waitcv);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
 	}
-
-	// Initialize the condition variable that will be needed for waitpid
-	proc->proc_exit_cv = cv_create(name);
-	if (proc->proc_exit_cv == NULL) {
-		lock_destroy(proc->proc_exit_lock);
-		lock_destroy(proc->proc_children_lock);
+	proc->p_threadcv = cv_create(name);
+	if (proc->p_threadcv == NULL) {
+		lock_destroy(proc->p_threadlock);
+		cv_destroy(proc->p_waitcv);
 		kfree(proc->p_name);
 		kfree(proc);
 		return NULL;
 	}
 
-	int rtn_val = proc_assign_pid((pid_t*)&proc->pid);
+	int rtn_val = proc_assign_pid(proc);
 	if (rtn_val) {
-		lock_destroy(proc->proc_exit_lock);
-		lock_destroy(proc->proc_children_lock);
-		cv_destroy(proc->proc_exit_cv);
+		cv_destroy(proc->p_waitcv);
+		lock_destroy(proc->p_threadlock);
+		cv_destroy(proc->p_threadcv);
 		kfree(proc->p_name);
 		kfree(proc);
 		return NULL;
@@ -139,14 +210,24 @@ proc_create(const char *name)
 
 
 	threadarray_init(&proc->p_threads);
-	// Initialize the proc array siilar to threadarray
-	procarray_init(&proc->proc_children);
 	spinlock_init(&proc->p_lock);
 	
 	// Proc has just been created, so set the exited predicate to false
 	proc->proc_exited = false;
-	proc->proc_parent_exited = false;
 	proc->proc_exit_status = 0;
+	proc->p_parent = NULL;
+	proc->proc_children.pl_head = proc->proc_children.pl_tail = NULL;
+	proc->p_zombies.pl_head = proc->p_zombies.pl_tail = NULL;
+	proc->p_sibnext = proc->p_sibprev = NULL;
+
+	// No user threads yet; runprogram and fork add the first one
+	bzero(proc->p_uthreads, sizeof(proc->p_uthreads));
+	proc->p_nuthreads = 0;
+	proc->p_exiting = false;
+
+	bzero(&proc->p_ru, sizeof(proc->p_ru));
+	bzero(&proc->p_cru, sizeof(proc->p_cru));
+
 	/* VM fields */
 	proc->p_addrspace = NULL;
 
@@ -220,14 +301,20 @@ proc_destroy(struct proc *proc)
 	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
 	//Cleanup all proc stuff for A2
-	int numChildren = procarray_num(&proc->proc_children);
-		for (int i = numChildren - 1; i >= 0; i--) {
-		procarray_remove(&proc->proc_children, i);
+	if (proc->p_parent != NULL) {
+		// It never ran (fork or spawn failed); take it off the
+		// parent's list, and wake the parent in case it's waiting
+		// for any child and this was the last.
+		lock_acquire(proc_tree_lock);
+		proclist_remove(&proc->p_parent->proc_children, proc);
+		cv_broadcast(proc->p_parent->p_waitcv, proc_tree_lock);
+		lock_release(proc_tree_lock);
 	}
-	procarray_cleanup(&proc->proc_children);
-	lock_destroy(proc->proc_exit_lock);
-	lock_destroy(proc->proc_children_lock);
-	cv_destroy(proc->proc_exit_cv);
+	KASSERT(proc->proc_children.pl_head == NULL);
+	KASSERT(proc->p_zombies.pl_head == NULL);
+	cv_destroy(proc->p_waitcv);
+	lock_destroy(proc->p_threadlock);
+	cv_destroy(proc->p_threadcv);
 
 	// Proc is being destroyed, so now the pid can be re-used
 	proc_set_pid_unused(proc->pid);
@@ -255,8 +342,20 @@ proc_destroy(struct proc *proc)
 
 
 
-// Sets the exit status of the process to true and encodes the exit status
-void proc_set_exit_status(struct proc * proc, const int exitcode, const int type) {
+/*
+ * Sets the exit status of the process to true and encodes the exit status,
+ * then moves it from its parent's list of children to the end of its list
+ * of zombies, and wakes up the parent in case it's in waitpid.
+ *
+ * This must be the last thing the exiting thread does with the process,
+ * since the parent may destroy it as soon as we let go of the tree lock.
+ * Returns false if there's no parent to do that, in which case the caller
+ * should destroy the process itself.
+ */
+bool proc_set_exit_status(struct proc * proc, const int exitcode, const int type) {
+	struct proc *parent;
+
+	lock_acquire(proc_tree_lock);
 	switch(type) {
 		case __WEXITED:
 		proc->proc_exit_status = _MKWAIT_EXIT(exitcode);
@@ -272,53 +371,191 @@ void proc_set_exit_status(struct proc * proc, const int exitcode, const int type
 		break;
 	}
 	proc->proc_exited = true;
+
+	parent = proc->p_parent;
+	if (parent != NULL) {
+		proclist_remove(&parent->proc_children, proc);
+	}
+	if (parent == NULL || parent == kproc) {
+		// No one will wait for it.
+		proc->p_parent = NULL;
+		lock_release(proc_tree_lock);
+		return false;
+	}
+	proclist_addtail(&parent->p_zombies, proc);
+	cv_broadcast(parent->p_waitcv, proc_tree_lock);
+	lock_release(proc_tree_lock);
+	return true;
 }
 
 
 
-// Assigns the next avail. pid to the process
-int proc_assign_pid(int * proc_pid_addr_ptr) {
-	if (proc_pid_addr_ptr == NULL) {
+// Assigns the next avail. pid to the process, searching from where the
+// last search left off. The kernel gets 0 and the first user process 1;
+// after that pids wrap around to PID_MIN.
+int proc_assign_pid(struct proc * proc) {
+	pid_t pid, start;
+
+	if (proc == NULL) {
 		return EINVAL;
-	}else {
-		spinlock_acquire(&proc_id_map_spinlock);
-		int rtn = bitmap_alloc(proc_id_map, (unsigned*)proc_pid_addr_ptr);
-		spinlock_release(&proc_id_map_spinlock);
-		return rtn;
 	}
+	spinlock_acquire(&proc_table_lock);
+	start = proc_nextpid;
+	pid = start;
+	while (proc_table[pid] != NULL) {
+		pid = (pid + 1 < PID_MAX) ? pid + 1 : PID_MIN;
+		if (pid == start) {
+			spinlock_release(&proc_table_lock);
+			return ENPROC;
+		}
+	}
+	proc_table[pid] = proc;
+	proc_nextpid = (pid + 1 < PID_MAX) ? pid + 1 : PID_MIN;
+	spinlock_release(&proc_table_lock);
+
+	*(pid_t *)&proc->pid = pid;
+	return 0;
 }
 
-// Sets the given pid to unused, so that it can be assigned later on.
+// Takes the given pid out of the table, so that it can be assigned later on.
 void proc_set_pid_unused(const int pid) {
 	KASSERT(pid > 0 && pid < PID_MAX);
-	spinlock_acquire(&proc_id_map_spinlock);
-	bitmap_unmark(proc_id_map, pid);
-	spinlock_release(&proc_id_map_spinlock);
+	spinlock_acquire(&proc_table_lock);
+	KASSERT(proc_table[pid] != NULL);
+	proc_table[pid] = NULL;
+	spinlock_release(&proc_table_lock);
 }
 
 /*
  * Finds the children of the given process proc that matches the process
  * id child_pid, and returns it. If there is no child with the given pid,
- * returns NULL.
+ * returns NULL. Call with the tree lock held; the child can't go away
+ * while we hold it.
  */
+static
 struct proc * proc_find_child(struct proc * proc, const int child_pid) {
-	struct proc * child_proc = NULL;
-	if (proc == NULL) {
+	struct proc * child_proc;
+
+	KASSERT(lock_do_i_hold(proc_tree_lock));
+	if (child_pid <= 0 || child_pid >= PID_MAX) {
 		return NULL;
 	}
-	// Acquire the lock for the children of the given process
-	lock_acquire(proc->proc_children_lock);
-	// Get the number of children this process has
-	int num_children = procarray_num(&proc->proc_children);
-	for (int i = 0; i < num_children; i++) {
-		struct proc * child = procarray_get(&proc->proc_children, i);
-		if (child->pid == child_pid) {
-			child_proc = child;
+	spinlock_acquire(&proc_table_lock);
+	child_proc = proc_table[child_pid];
+	spinlock_release(&proc_table_lock);
+	if (child_proc != NULL && child_proc->p_parent != proc) {
+		child_proc = NULL;
+	}
+	return child_proc;
+}
+
+/*
+ * Waits for a child of proc to exit and reaps it; see proc.h. A specific
+ * child is found through the pid table, and any child is just the first
+ * zombie, so neither looks through the children.
+ */
+int proc_wait_child(struct proc *proc, pid_t pid, bool nohang,
+		    int *status, pid_t *childpid) {
+	struct proc *child;
+
+	lock_acquire(proc_tree_lock);
+	while (1) {
+		if (pid == -1) {
+			child = proc->p_zombies.pl_head;
+			if (child == NULL && proc->proc_children.pl_head == NULL) {
+				lock_release(proc_tree_lock);
+				return ECHILD;
+			}
+		} else {
+			child = proc_find_child(proc, pid);
+			if (child == NULL) {
+				lock_release(proc_tree_lock);
+				return waitpid_interested_error(pid);
+			}
+			if (!child->proc_exited) {
+				child = NULL;
+			}
+		}
+		if (child != NULL) {
 			break;
 		}
+		if (nohang) {
+			lock_release(proc_tree_lock);
+			*childpid = 0;
+			return 0;
+		}
+		if (proc->p_exiting) {
+			lock_release(proc_tree_lock);
+			return EINTR;
+		}
+		cv_wait(proc->p_waitcv, proc_tree_lock);
 	}
-	lock_release(proc->proc_children_lock);
-	return child_proc;
+
+	proclist_remove(&proc->p_zombies, child);
+	child->p_parent = NULL;
+	*status = child->proc_exit_status;
+	*childpid = child->pid;
+	lock_release(proc_tree_lock);
+
+	// The child's usage, and its children's, now count as ours
+	spinlock_acquire(&proc->p_lock);
+	rucounts_add(&proc->p_cru, &child->p_ru);
+	rucounts_add(&proc->p_cru, &child->p_cru);
+	spinlock_release(&proc->p_lock);
+
+	proc_destroy(child);
+	return 0;
+}
+
+/*
+ * Totals up the resource usage for getrusage; see proc.h. For
+ * RUSAGE_SELF that includes the threads still running, which may be
+ * bumping their counts as we read them.
+ */
+int proc_getrusage(struct proc *proc, int who, struct rusage *ru) {
+	struct rucounts rc;
+	struct thread *t;
+	unsigned i, num;
+
+	spinlock_acquire(&proc->p_lock);
+	switch (who) {
+	    case RUSAGE_SELF:
+		rc = proc->p_ru;
+		num = threadarray_num(&proc->p_threads);
+		for (i=0; i<num; i++) {
+			t = threadarray_get(&proc->p_threads, i);
+			rucounts_add(&rc, &t->t_ru);
+		}
+		break;
+	    case RUSAGE_CHILDREN:
+		rc = proc->p_cru;
+		break;
+	    default:
+		spinlock_release(&proc->p_lock);
+		return EINVAL;
+	}
+	spinlock_release(&proc->p_lock);
+
+	bzero(ru, sizeof(*ru));
+	ru->ru_utime.tv_sec = rc.rc_uticks / HZ;
+	ru->ru_utime.tv_usec = (rc.rc_uticks % HZ) * (1000000 / HZ);
+	ru->ru_stime.tv_sec = rc.rc_sticks / HZ;
+	ru->ru_stime.tv_usec = (rc.rc_sticks % HZ) * (1000000 / HZ);
+	ru->ru_minflt = rc.rc_faults;
+	ru->ru_nvcsw = rc.rc_nvcsw;
+	ru->ru_nivcsw = rc.rc_nivcsw;
+	ru->ru_inbytes = rc.rc_inbytes;
+	ru->ru_outbytes = rc.rc_outbytes;
+	return 0;
+}
+
+/*
+ * Called by _exit after setting p_exiting.
+ */
+void proc_wait_interrupt(struct proc *proc) {
+	lock_acquire(proc_tree_lock);
+	cv_broadcast(proc->p_waitcv, proc_tree_lock);
+	lock_release(proc_tree_lock);
 }
 
 
@@ -329,22 +566,25 @@ struct proc * proc_find_child(struct proc * proc, const int child_pid) {
  * that the parent is destroyed, there is no relationship.
  */
 void proc_exited_signal(struct proc *proc) {
-	lock_acquire(proc->proc_children_lock);
-	unsigned int i;
-	for (i=0; i < procarray_num(&proc->proc_children); i++) {
-		struct proc * child = procarray_get(&proc->proc_children, i);
-		lock_acquire(child->proc_exit_lock);
-		if (child->proc_exited) {
-			// Destroy all the semi-destroyed children, since there is no
-			// longer a parent-child relationship or interest.
-			lock_release(child->proc_exit_lock);
-			proc_destroy(child);
-		} else {
-			child->proc_parent_exited = true;
-			lock_release(child->proc_exit_lock);
-		}
+	struct proc *child, *zombies;
+
+	lock_acquire(proc_tree_lock);
+	while ((child = proc->proc_children.pl_head) != NULL) {
+		proclist_remove(&proc->proc_children, child);
+		child->p_parent = NULL;
+	}
+	// Take the semi-destroyed children, since there is no longer a
+	// parent-child relationship or interest, and destroy them below.
+	zombies = proc->p_zombies.pl_head;
+	proc->p_zombies.pl_head = proc->p_zombies.pl_tail = NULL;
+	lock_release(proc_tree_lock);
+
+	while (zombies != NULL) {
+		child = zombies;
+		zombies = child->p_sibnext;
+		child->p_parent = NULL;
+		proc_destroy(child);
 	}
-	lock_release(proc->proc_children_lock);
 }
 
 /*
@@ -356,9 +596,9 @@ int waitpid_interested_error(const int pid) {
 	if ( pid <= 0 || pid >= PID_MAX){
 		return EINVAL;
 	}
-	spinlock_acquire(&proc_id_map_spinlock);
-	int is_set = bitmap_isset(proc_id_map, pid);
-	spinlock_release(&proc_id_map_spinlock);
+	spinlock_acquire(&proc_table_lock);
+	int is_set = proc_table[pid] != NULL;
+	spinlock_release(&proc_table_lock);
 	return is_set? ECHILD:ESRCH;
 }
 
@@ -391,9 +631,8 @@ void proc_semi_destroy(struct proc *proc) {
 	}
 
 
-	threadarray_cleanup(&proc->p_threads);
-	spinlock_cleanup(&proc->p_lock);
-// NOTICE how we do not clean up the entire process
+// NOTICE how we do not clean up the entire process (the parent does that
+// with proc_destroy when it reaps it)
 //	P(proc_count_mutex);
 //        KASSERT(proc_count > 0);
 //        proc_count--;
@@ -411,12 +650,18 @@ void proc_semi_destroy(struct proc *proc) {
 void
 proc_bootstrap(void)
 {
-  // Before creating the kernel process, initialize the pid_bitmap
+  // Before creating the kernel process, initialize the pid table
   // so that the kernel proc can be assigned a pid starting at 0
-  spinlock_init(&proc_id_map_spinlock);
-  proc_id_map = bitmap_create(PID_MAX);
-  if (proc_id_map == NULL) {
-	panic("failed to initialize the pid map for pid generation\n");
+  spinlock_init(&proc_table_lock);
+  proc_table = kmalloc(PID_MAX * sizeof(struct proc *));
+  if (proc_table == NULL) {
+	panic("failed to initialize the pid table for pid generation\n");
+  }
+  bzero(proc_table, PID_MAX * sizeof(struct proc *));
+  proc_nextpid = 0;
+  proc_tree_lock = lock_create("proc_tree");
+  if (proc_tree_lock == NULL) {
+	panic("could not create the process tree lock\n");
   }
   // Ready to create the kernel process
   kproc = proc_create("[kernel]");
@@ -469,6 +714,10 @@ proc_create_runprogram(const char *name)
 
 	proc->p_addrspace = NULL;
 
+	/* The caller is about to give it its first thread. */
+	proc->p_uthreads[0].ut_used = true;
+	proc->p_nuthreads = 1;
+
 	/* VFS fields */
 
 #ifdef UW
@@ -498,13 +747,10 @@ proc_create_runprogram(const char *name)
 #endif // UW
 
 	// Add this new proc as a child to the parent proc
-	lock_acquire(curproc->proc_children_lock);
-	if(procarray_add(&curproc->proc_children, proc, NULL)) {
-		proc_destroy(proc);
-		lock_release(curproc->proc_children_lock);
-		return NULL;
-	}
-	lock_release(curproc->proc_children_lock);
+	lock_acquire(proc_tree_lock);
+	proclist_addtail(&curproc->proc_children, proc);
+	proc->p_parent = curproc;
+	lock_release(proc_tree_lock);
 
 	return proc;
 }
@@ -523,23 +769,40 @@ void proc_clear_as(struct proc *proc) {
 }
 
 
+/*
+ * Creates the process for a child of the current process, proc. The
+ * expensive part, copying the address space, is done first, before the
+ * child exists, so nothing has to be locked or disabled around it; the
+ * child only becomes visible once proc_create_runprogram links it into
+ * the process tree, and doesn't run until the caller gives it a thread.
+ */
 struct proc * proc_fork(struct proc * proc){
 	struct proc *child_proc;
 	if (proc == NULL) {
 		return NULL;
 	}
-	child_proc = proc_create_runprogram(proc->p_name);
+	KASSERT(proc == curproc);
 	struct addrspace * parent_as = curproc_getas();
 	struct addrspace * child_as = NULL;
 	if (parent_as != NULL) {
 		// Copy the parent address space to the child address space
-		as_copy(parent_as, &child_as);
-		if (child_as == NULL) {
+		if (as_copy(parent_as, &child_as)) {
 			return NULL;
 		}
 	}
+	child_proc = proc_create_runprogram(proc->p_name);
+	if (child_proc == NULL) {
+		if (child_as != NULL) {
+			as_destroy(child_as);
+		}
+		return NULL;
+	}
 	// Set the childs address space
 	child_proc->p_addrspace = child_as;
+	// The child's thread is a copy of the calling one, and keeps its
+	// id, since it's running on that thread's stack
+	child_proc->p_uthreads[0].ut_used = false;
+	child_proc->p_uthreads[curthread->t_tid].ut_used = true;
 	return child_proc;
 }
 
@@ -583,6 +846,8 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			rucounts_add(&proc->p_ru, &t->t_ru);
+			bzero(&t->t_ru, sizeof(t->t_ru));
 			spinlock_release(&proc->p_lock);
 			t->t_proc = NULL;
 			return;
@@ -38,11 +38,15 @@
 #include <lib.h>
 #include <spl.h>
 #include <clock.h>
+#include <lockstat.h>
+#include <taskq.h>
+#include <threadpool.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
 #include <vm.h>
+#include <sharedpage.h>
 #include <mainbus.h>
 #include <vfs.h>
 #include <device.h>
@@ -111,7 +115,10 @@ boot(void)
 	proc_bootstrap();
 	thread_bootstrap();
 	hardclock_bootstrap();
+	taskq_startcpu();
+	threadpool_startcpu();
 	vfs_bootstrap();
+	futex_bootstrap();
 
 	/* Probe and initialize devices. Interrupts should come on. */
 	kprintf("Device probe...\n");
@@ -124,7 +131,11 @@ boot(void)
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
+	sharedpage_bootstrap();
 	kprintf_bootstrap();
+#if OPT_LOCKSTAT
+	lockstat_bootstrap();
+#endif
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -34,7 +34,10 @@
 #include <limits.h>
 #include <lib.h>
 #include <uio.h>
+#include <addrspace.h>
 #include <clock.h>
+#include <lockstat.h>
+#include <taskq.h>
 #include <thread.h>
 #include <proc.h>
 #include <vfs.h>
@@ -44,6 +47,8 @@
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
+#include "opt-syscallstat.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -400,6 +405,100 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_threadstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_threadcachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_cachestats();
+
+	return 0;
+}
+
+static
+int
+cmd_taskqstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	taskq_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_elfcachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	elfcache_printstats();
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for printing lock statistics: the N (default 10) locks
+ * with the most time spent waiting for them.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	int n = 10;
+
+	if (nargs > 2) {
+		kprintf("Usage: ls [count]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		n = atoi(args[1]);
+		if (n <= 0) {
+			kprintf("Usage: ls [count]\n");
+			return EINVAL;
+		}
+	}
+
+	lockstat_dump(n);
+
+	return 0;
+}
+#endif
+
+#if OPT_SYSCALLSTAT
+/*
+ * Command for printing syscall statistics.
+ */
+static
+int
+cmd_syscallstat(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	syscallstat_dump();
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -469,6 +568,12 @@ static const char *testmenu[] = {
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[sy4] Lock contention benchmark     ",
+	"[sy5] RW lock reader scaling test   ",
+	"[slb] Spinlock fairness benchmark   ",
+	"[pi]  Priority inheritance test     ",
+	"[tqt] Task queue test               ",
+	"[pzb] Parallel zeroing benchmark    ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress        (4)     ",
 	"[fs3] FS write stress       (4)     ",
@@ -513,6 +618,16 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[ts] Thread scheduler stats         ",
+	"[tc] Thread cache stats             ",
+	"[tq] Task queue stats               ",
+	"[ec] Exec cache stats               ",
+#if OPT_LOCKSTAT
+	"[ls] Lock statistics                ",
+#endif
+#if OPT_SYSCALLSTAT
+	"[sc] Syscall statistics             ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -568,6 +683,16 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "ts",         cmd_threadstats },
+	{ "tc",         cmd_threadcachestats },
+	{ "tq",         cmd_taskqstats },
+	{ "ec",         cmd_elfcachestats },
+#if OPT_LOCKSTAT
+	{ "ls",         cmd_lockstat },
+#endif
+#if OPT_SYSCALLSTAT
+	{ "sc",         cmd_syscallstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -585,6 +710,12 @@ static struct {
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	lockbench },
+	{ "sy5",	rwtest },
+	{ "slb",	spinlockbench },
+	{ "pi",	pitest },
+	{ "tqt",	taskqtest },
+	{ "pzb",	pzerobench },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 #endif
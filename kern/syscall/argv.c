@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Argument vectors for execv and spawn: copy one in from the calling
+ * process, and out onto the new program's stack.
+ *
+ * The arguments are staged in an ARG_MAX buffer laid out exactly as
+ * they will be on the new stack: the argv array, with its NULL, and
+ * then the strings packed end to end. While staged, the argv entries
+ * hold the offset of each string in the buffer; argbuf_copyout turns
+ * them into user addresses and copies the whole thing out at once.
+ *
+ * Staging buffers are big, so rather than kmalloc and kfree one for
+ * every exec, we keep a few around.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <limits.h>
+#include <spinlock.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* How many spare staging buffers to keep */
+#define ARGBUF_NCACHE 2
+
+/* How many argv pointers to copy in at a time */
+#define ARGBUF_BATCH 32
+
+static struct spinlock argbuf_cachelock = SPINLOCK_INITIALIZER;
+static char *argbuf_cache[ARGBUF_NCACHE];
+static unsigned argbuf_ncached;
+
+static
+char *
+argbuf_getbuf(void)
+{
+	char *buf = NULL;
+
+	spinlock_acquire(&argbuf_cachelock);
+	if (argbuf_ncached > 0) {
+		buf = argbuf_cache[--argbuf_ncached];
+	}
+	spinlock_release(&argbuf_cachelock);
+
+	if (buf == NULL) {
+		buf = kmalloc(ARG_MAX);
+	}
+	return buf;
+}
+
+static
+void
+argbuf_putbuf(char *buf)
+{
+	spinlock_acquire(&argbuf_cachelock);
+	if (argbuf_ncached < ARGBUF_NCACHE) {
+		argbuf_cache[argbuf_ncached++] = buf;
+		buf = NULL;
+	}
+	spinlock_release(&argbuf_cachelock);
+
+	if (buf != NULL) {
+		kfree(buf);
+	}
+}
+
+/*
+ * Copy in the NULL-terminated argument vector UARGV. The whole lot,
+ * the argv array and the strings, has to fit in ARG_MAX, or we fail
+ * with E2BIG.
+ *
+ * The argv array is copied in ARGBUF_BATCH pointers at a time, but
+ * never across a page boundary, since the array may end just before
+ * an unmapped page.
+ */
+int
+argbuf_copyin(struct argbuf *ab, userptr_t uargv)
+{
+	userptr_t *argv;
+	vaddr_t uaddr;
+	size_t len, pos, n, i;
+	int result;
+
+	ab->ab_argc = 0;
+	ab->ab_len = 0;
+	ab->ab_buf = NULL;
+	if ((vaddr_t)uargv % sizeof(userptr_t) != 0) {
+		return EFAULT;
+	}
+	ab->ab_buf = argbuf_getbuf();
+	if (ab->ab_buf == NULL) {
+		return ENOMEM;
+	}
+	argv = (userptr_t *)ab->ab_buf;
+
+	/* Get the argv array, up to and including the NULL. */
+	n = 0;
+	while (1) {
+		uaddr = (vaddr_t)uargv + n * sizeof(userptr_t);
+		len = (PAGE_SIZE - (uaddr & ~PAGE_FRAME)) / sizeof(userptr_t);
+		if (len > ARGBUF_BATCH) {
+			len = ARGBUF_BATCH;
+		}
+		if ((n + len) * sizeof(userptr_t) > ARG_MAX) {
+			len = ARG_MAX / sizeof(userptr_t) - n;
+			if (len == 0) {
+				result = E2BIG;
+				goto fail;
+			}
+		}
+		result = copyin((const_userptr_t)uaddr, &argv[n],
+				len * sizeof(userptr_t));
+		if (result) {
+			goto fail;
+		}
+		for (i=n; i<n+len && argv[i] != NULL; i++);
+		if (i < n+len) {
+			ab->ab_argc = i;
+			break;
+		}
+		n += len;
+	}
+
+	/* Now the strings, packed in after it. */
+	pos = ROUNDUP((ab->ab_argc + 1) * sizeof(userptr_t), 8);
+	for (i=0; i<(size_t)ab->ab_argc; i++) {
+		if (pos >= ARG_MAX) {
+			result = E2BIG;
+			goto fail;
+		}
+		result = copyinstr(argv[i], ab->ab_buf + pos, ARG_MAX - pos,
+				   &len);
+		if (result == ENAMETOOLONG) {
+			result = E2BIG;
+		}
+		if (result) {
+			goto fail;
+		}
+		argv[i] = (userptr_t)pos;
+		pos += len;	/* len includes the null */
+	}
+	ab->ab_len = pos;
+	return 0;
+
+ fail:
+	argbuf_cleanup(ab);
+	return result;
+}
+
+/*
+ * Copy the arguments out onto the new program's stack, which starts at
+ * *STACKPTR, with one copyout. Updates *STACKPTR, which is left 8-byte
+ * aligned, and sets *UARGV to the user address of the argv array, which
+ * is at the new stack pointer.
+ */
+int
+argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *uargv)
+{
+	userptr_t *argv = (userptr_t *)ab->ab_buf;
+	vaddr_t stack;
+	int i, result;
+
+	stack = *stackptr - ROUNDUP(ab->ab_len, 8);
+	for (i=0; i<ab->ab_argc; i++) {
+		argv[i] = (userptr_t)(stack + (vaddr_t)argv[i]);
+	}
+
+	result = copyout(ab->ab_buf, (userptr_t)stack, ab->ab_len);
+	if (result) {
+		return result;
+	}
+
+	*stackptr = stack;
+	*uargv = (userptr_t)stack;
+	return 0;
+}
+
+void
+argbuf_cleanup(struct argbuf *ab)
+{
+	if (ab->ab_buf != NULL) {
+		argbuf_putbuf(ab->ab_buf);
+		ab->ab_buf = NULL;
+	}
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Futexes: blocking for user-level synchronization.
+ *
+ * futex_wait(addr, expected) sleeps if the int at ADDR still holds
+ * EXPECTED; futex_wake(addr, n) wakes up to N threads sleeping on ADDR.
+ * A user-level lock built on these only comes into the kernel when it
+ * has to sleep or someone has to be woken, and the check in
+ * futex_wait is made under the same lock as futex_wake takes, so a
+ * wakeup can't slip in between the check and going to sleep.
+ *
+ * Sleepers are keyed by address space and user address, and hashed
+ * into a fixed table of buckets, each with a lock, a CV, and a list
+ * of the sleepers. Sleepers whose keys collide share the CV, so a
+ * wakeup for one address wakes up the whole bucket; everyone whose
+ * own wakeup hasn't come goes back to sleep.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <synch.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+#define FUTEX_NBUCKETS 64
+
+struct futex_waiter {
+	struct addrspace *fw_as;
+	vaddr_t fw_addr;
+	bool fw_woken;
+	struct futex_waiter *fw_next;
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;
+	struct cv *fb_cv;
+	struct futex_waiter *fb_waiters;	/* In the order they came */
+};
+
+static struct futex_bucket futex_table[FUTEX_NBUCKETS];
+
+/*
+ * Set up the hash table.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		futex_table[i].fb_lock = lock_create("futex");
+		futex_table[i].fb_cv = cv_create("futex");
+		if (futex_table[i].fb_lock == NULL ||
+		    futex_table[i].fb_cv == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_table[i].fb_waiters = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_bucket(struct addrspace *as, vaddr_t addr)
+{
+	unsigned h;
+
+	h = ((uintptr_t)as >> 4) ^ (addr >> 2);
+	return &futex_table[h % FUTEX_NBUCKETS];
+}
+
+/*
+ * Get threads of the current process out of futex_wait, because it
+ * is exiting. Called by _exit after setting p_exiting.
+ */
+void
+futex_exiting(void)
+{
+	unsigned i;
+
+	KASSERT(curproc->p_exiting);
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		lock_acquire(futex_table[i].fb_lock);
+		if (futex_table[i].fb_waiters != NULL) {
+			cv_broadcast(futex_table[i].fb_cv,
+				     futex_table[i].fb_lock);
+		}
+		lock_release(futex_table[i].fb_lock);
+	}
+}
+
+/*
+ * Sleep until woken by futex_wake on ADDR, unless *ADDR is no longer
+ * EXPECTED, in which case fail with EAGAIN straight away.
+ */
+int
+sys_futex_wait(userptr_t addr, int expected)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter fw, **pp;
+	int val, result;
+
+	if ((vaddr_t)addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	fw.fw_as = curproc_getas();
+	fw.fw_addr = (vaddr_t)addr;
+	fw.fw_woken = false;
+	fw.fw_next = NULL;
+	fb = futex_bucket(fw.fw_as, fw.fw_addr);
+
+	lock_acquire(fb->fb_lock);
+	result = copyin(addr, &val, sizeof(int));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (val != expected) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	for (pp = &fb->fb_waiters; *pp != NULL; pp = &(*pp)->fw_next);
+	*pp = &fw;
+
+	while (!fw.fw_woken && !curproc->p_exiting) {
+		cv_wait(fb->fb_cv, fb->fb_lock);
+	}
+
+	if (!fw.fw_woken) {
+		/* Still on the list; take it off. */
+		for (pp = &fb->fb_waiters; *pp != &fw; pp = &(*pp)->fw_next);
+		*pp = fw.fw_next;
+		result = EINTR;
+	}
+	lock_release(fb->fb_lock);
+	return result;
+}
+
+/*
+ * Wake up to N threads sleeping in futex_wait on ADDR, oldest first.
+ * Returns how many were woken.
+ */
+int
+sys_futex_wake(userptr_t addr, int n, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter *fw, **pp;
+	struct addrspace *as;
+	int woken;
+
+	if ((vaddr_t)addr % sizeof(int) != 0 || n < 0) {
+		return EINVAL;
+	}
+
+	as = curproc_getas();
+	fb = futex_bucket(as, (vaddr_t)addr);
+	woken = 0;
+
+	lock_acquire(fb->fb_lock);
+	pp = &fb->fb_waiters;
+	while (*pp != NULL && woken < n) {
+		fw = *pp;
+		if (fw->fw_as == as && fw->fw_addr == (vaddr_t)addr) {
+			*pp = fw->fw_next;
+			fw->fw_woken = true;
+			woken++;
+		}
+		else {
+			pp = &fw->fw_next;
+		}
+	}
+	if (woken > 0) {
+		cv_broadcast(fb->fb_cv, fb->fb_lock);
+	}
+	lock_release(fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
@@ -48,18 +48,227 @@
  * To support dynamically linked executables with shared libraries
  * you'd need to change this to load the "ELF interpreter" (dynamic
  * linker). And you'd have to write a dynamic linker...
+ *
+ * The same few programs tend to get run over and over, so what we get
+ * from the headers (the entry point and where each segment goes) is
+ * kept in a small cache, and next time only the segments themselves
+ * need to be read. Entries are keyed by filesystem and inode number
+ * (from VOP_STAT), since the vnode itself is usually reclaimed as
+ * soon as the program's been loaded, and checked against the file's
+ * size. Files with no inode number aren't cached; that includes
+ * everything on emufs, whose handles are reused for other files
+ * once closed. Neither of our filesystems keeps modification times, so
+ * changes are tracked with the vnode's write generation instead (see
+ * vnode.h): an entry remembers the vnode it was last seen through,
+ * and is dropped if the file is changed through that vnode, whether
+ * we notice on the next exec or when the vnode is reclaimed. A vnode
+ * loaded afresh has seen no writes yet, so it can take over the
+ * entry. The segment contents aren't cached; with dumbvm every
+ * process gets its own copy anyway.
  */
 
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <stat.h>
 #include <uio.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
+#include <spinlock.h>
 #include <elf.h>
 
+/* Most loadable segments we handle (dumbvm only handles two anyway) */
+#define ELF_MAXSEGS 4
+
+/* Number of programs in the cache */
+#define ELFCACHE_SIZE 8
+
+/* What load_elf needs from the headers. */
+struct elf_image {
+	vaddr_t ei_entry;
+	unsigned ei_nsegs;
+	struct {
+		off_t es_offset;
+		vaddr_t es_vaddr;
+		size_t es_memsz;
+		size_t es_filesz;
+		uint32_t es_flags;	/* PF_R, PF_W, PF_X */
+	} ei_segs[ELF_MAXSEGS];
+};
+
+struct elfcache_entry {
+	struct fs *ec_fs;		/* NULL if the entry is free */
+	ino_t ec_ino;
+	off_t ec_size;
+	struct vnode *ec_vn;		/* Vnode last seen through */
+	unsigned ec_serial;		/* ...its serial number */
+	unsigned ec_writegen;		/* ...and write generation */
+	unsigned ec_lastuse;		/* For LRU replacement */
+	struct elf_image ec_image;
+};
+
+static struct spinlock elfcache_lock = SPINLOCK_INITIALIZER;
+static struct elfcache_entry elfcache[ELFCACHE_SIZE];
+static unsigned elfcache_clock;
+static unsigned elfcache_hits, elfcache_misses, elfcache_stale;
+
+/*
+ * Look up V, whose stat information is ST, in the cache. If it's
+ * there and still current, copy out its image and return true.
+ */
+static
+bool
+elfcache_lookup(struct vnode *v, const struct stat *st,
+		struct elf_image *img)
+{
+	struct elfcache_entry *ec;
+	unsigned i;
+
+	spinlock_acquire(&elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		ec = &elfcache[i];
+		if (ec->ec_fs != v->vn_fs || ec->ec_ino != st->st_ino) {
+			continue;
+		}
+		if (ec->ec_vn != v || ec->ec_serial != v->vn_serial) {
+			/* A new vnode for the file; take it over if unwritten. */
+			if (v->vn_writegen == 0) {
+				ec->ec_vn = v;
+				ec->ec_serial = v->vn_serial;
+				ec->ec_writegen = 0;
+			}
+		}
+		if (ec->ec_writegen != v->vn_writegen ||
+		    ec->ec_size != st->st_size) {
+			/* The file has been changed. */
+			ec->ec_fs = NULL;
+			elfcache_stale++;
+			break;
+		}
+		ec->ec_lastuse = ++elfcache_clock;
+		*img = ec->ec_image;
+		elfcache_hits++;
+		spinlock_release(&elfcache_lock);
+		return true;
+	}
+	elfcache_misses++;
+	spinlock_release(&elfcache_lock);
+	return false;
+}
+
+/*
+ * Enter V's image in the cache, replacing the least recently used
+ * entry. ST and WRITEGEN are V's stat information and write
+ * generation from before the headers were read.
+ */
+static
+void
+elfcache_insert(struct vnode *v, const struct stat *st, unsigned writegen,
+		const struct elf_image *img)
+{
+	struct elfcache_entry *ec, *victim;
+	unsigned i;
+
+	spinlock_acquire(&elfcache_lock);
+	victim = &elfcache[0];
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		ec = &elfcache[i];
+		if (ec->ec_fs == v->vn_fs && ec->ec_ino == st->st_ino) {
+			/* Someone else just put it in. */
+			victim = ec;
+			break;
+		}
+		if (ec->ec_fs == NULL) {
+			victim = ec;
+		}
+		else if (victim->ec_fs != NULL &&
+			 ec->ec_lastuse < victim->ec_lastuse) {
+			victim = ec;
+		}
+	}
+	victim->ec_fs = v->vn_fs;
+	victim->ec_ino = st->st_ino;
+	victim->ec_size = st->st_size;
+	victim->ec_vn = v;
+	victim->ec_serial = v->vn_serial;
+	victim->ec_writegen = writegen;
+	victim->ec_lastuse = ++elfcache_clock;
+	victim->ec_image = *img;
+	spinlock_release(&elfcache_lock);
+}
+
+/*
+ * V, which has been written to, is being reclaimed. Drop any entry
+ * last seen through it that it has changed since, as the next vnode
+ * for the file won't know.
+ */
+void
+elfcache_vnodegone(struct vnode *v)
+{
+	struct elfcache_entry *ec;
+	unsigned i;
+
+	spinlock_acquire(&elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		ec = &elfcache[i];
+		if (ec->ec_fs != NULL && ec->ec_vn == v &&
+		    ec->ec_serial == v->vn_serial &&
+		    ec->ec_writegen != v->vn_writegen) {
+			ec->ec_fs = NULL;
+			elfcache_stale++;
+		}
+	}
+	spinlock_release(&elfcache_lock);
+}
+
+/*
+ * FS has been unmounted. Drop its entries, so a filesystem mounted
+ * later at the same address doesn't find them.
+ */
+void
+elfcache_fsgone(struct fs *fs)
+{
+	unsigned i;
+
+	spinlock_acquire(&elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		if (elfcache[i].ec_fs == fs) {
+			elfcache[i].ec_fs = NULL;
+		}
+	}
+	spinlock_release(&elfcache_lock);
+}
+
+/*
+ * Print the cache's hit rate.
+ */
+void
+elfcache_printstats(void)
+{
+	unsigned hits, misses, stale, used, i;
+
+	spinlock_acquire(&elfcache_lock);
+	hits = elfcache_hits;
+	misses = elfcache_misses;
+	stale = elfcache_stale;
+	used = 0;
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		if (elfcache[i].ec_fs != NULL) {
+			used++;
+		}
+	}
+	spinlock_release(&elfcache_lock);
+
+	kprintf("exec cache: %u hits, %u misses (%u out of date)",
+		hits, misses, stale);
+	if (hits + misses > 0) {
+		kprintf(", %u%% hit rate", hits * 100 / (hits + misses));
+	}
+	kprintf("; %u/%u entries in use\n", used, ELFCACHE_SIZE);
+}
+
 /*
  * Load a segment at virtual address VADDR. The segment in memory
  * extends from VADDR up to (but not including) VADDR+MEMSIZE. The
@@ -146,21 +355,18 @@ load_segment(struct addrspace *as, struct vnode *v,
 }
 
 /*
- * Load an ELF executable user program into the current address space.
- *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * Read the executable header and the program headers of V, and fill
+ * in IMG from them.
  */
+static
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+elf_readheaders(struct vnode *v, struct elf_image *img)
 {
 	Elf_Ehdr eh;   /* Executable header */
 	Elf_Phdr ph;   /* "Program header" = segment header */
 	int result, i;
 	struct iovec iov;
 	struct uio ku;
-	struct addrspace *as;
-
-	as = curproc_getas();
 
 	/*
 	 * Read the executable header from offset 0 in the file.
@@ -203,12 +409,11 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	}
 
 	/*
-	 * Go through the list of segments and set up the address space.
+	 * Go through the list of segments and note the ones to load.
 	 *
 	 * Ordinarily there will be one code segment, one read-only
 	 * data segment, and one data/bss segment, but there might
-	 * conceivably be more. You don't need to support such files
-	 * if it's unduly awkward to do so.
+	 * conceivably be more. We handle up to ELF_MAXSEGS.
 	 *
 	 * Note that the expression eh.e_phoff + i*eh.e_phentsize is 
 	 * mandated by the ELF standard - we use sizeof(ph) to load,
@@ -217,6 +422,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * to find where the phdr starts.
 	 */
 
+	img->ei_nsegs = 0;
 	for (i=0; i<eh.e_phnum; i++) {
 		off_t offset = eh.e_phoff + i*eh.e_phentsize;
 		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
@@ -243,11 +449,64 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
+		if (img->ei_nsegs == ELF_MAXSEGS) {
+			kprintf("loadelf: too many segments\n");
+			return ENOEXEC;
+		}
+		img->ei_segs[img->ei_nsegs].es_offset = ph.p_offset;
+		img->ei_segs[img->ei_nsegs].es_vaddr = ph.p_vaddr;
+		img->ei_segs[img->ei_nsegs].es_memsz = ph.p_memsz;
+		img->ei_segs[img->ei_nsegs].es_filesz = ph.p_filesz;
+		img->ei_segs[img->ei_nsegs].es_flags = ph.p_flags;
+		img->ei_nsegs++;
+	}
+
+	img->ei_entry = eh.e_entry;
+	return 0;
+}
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct elf_image img;
+	struct stat st;
+	unsigned writegen, i;
+	bool cacheable;
+	int result;
+	struct addrspace *as;
+
+	as = curproc_getas();
+
+	/* Get the generation first, in case of a write meanwhile. */
+	writegen = v->vn_writegen;
+	cacheable = v->vn_fs != NULL && VOP_STAT(v, &st) == 0 &&
+		st.st_ino != 0;
+	if (!cacheable || !elfcache_lookup(v, &st, &img)) {
+		result = elf_readheaders(v, &img);
+		if (result) {
+			return result;
+		}
+		if (cacheable) {
+			elfcache_insert(v, &st, writegen, &img);
+		}
+	}
+
+	/*
+	 * Set up the address space.
+	 */
+
+	for (i=0; i<img.ei_nsegs; i++) {
 		result = as_define_region(as,
-					  ph.p_vaddr, ph.p_memsz,
-					  ph.p_flags & PF_R,
-					  ph.p_flags & PF_W,
-					  ph.p_flags & PF_X);
+					  img.ei_segs[i].es_vaddr,
+					  img.ei_segs[i].es_memsz,
+					  img.ei_segs[i].es_flags & PF_R,
+					  img.ei_segs[i].es_flags & PF_W,
+					  img.ei_segs[i].es_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -262,35 +521,12 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * Now actually load each segment.
 	 */
 
-	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
-		if (result) {
-			return result;
-		}
-
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
-		}
-
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n", 
-				ph.p_type);
-			return ENOEXEC;
-		}
-
-		result = load_segment(as, v, ph.p_offset, ph.p_vaddr, 
-				      ph.p_memsz, ph.p_filesz,
-				      ph.p_flags & PF_X);
+	for (i=0; i<img.ei_nsegs; i++) {
+		result = load_segment(as, v, img.ei_segs[i].es_offset,
+				      img.ei_segs[i].es_vaddr, 
+				      img.ei_segs[i].es_memsz,
+				      img.ei_segs[i].es_filesz,
+				      img.ei_segs[i].es_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -301,7 +537,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return result;
 	}
 
-	*entrypoint = eh.e_entry;
+	*entrypoint = img.ei_entry;
 
 	return 0;
 }
@@ -6,6 +6,8 @@
 #include <kern/errno.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <lib.h>
 #include <syscall.h>
 #include <current.h>
@@ -14,7 +16,6 @@
 #include <addrspace.h>
 #include <copyinout.h>
 #include <synch.h>
-#include <spl.h>
 #include <mips/trapframe.h>
 #include <limits.h>
 #include <vm.h>
@@ -28,6 +29,10 @@ void sys__exit(int exitcode, int type) {
   struct proc *p = curproc;
 
   DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+
+  // Any other threads have to go before the address space does.
+  uthread_exitall();
+
   KASSERT(curproc->p_addrspace != NULL);
   as_deactivate();
   /*
@@ -41,41 +46,20 @@ void sys__exit(int exitcode, int type) {
   as_destroy(as);
 
 
-  lock_acquire(p->proc_exit_lock);
-
- 
- if(!p->proc_parent_exited && p->pid > 1){
-  
-
-  // Parent didnt exit yet, so we must only semi-destroy the proc
-  proc_set_exit_status(p,exitcode, type);
-
-  
-  cv_broadcast(p->proc_exit_cv, p->proc_exit_lock);
-
-
+  // Our children are orphaned now, and our zombies destroyed.
   proc_exited_signal(p);
-        /* detach this thread from its process */
-        /* note: curproc cannot be used after this call */
-
-
-        proc_remthread(curthread);
-  // semi_destroy will release the proc_exit_lock for us.
-
 
+  /* detach this thread from its process */
+  /* note: curproc cannot be used after this call */
+  proc_remthread(curthread);
   proc_semi_destroy(p);
 
-
-  lock_release(p->proc_exit_lock);
-  }else{
-  proc_exited_signal(p);
-  lock_release(p->proc_exit_lock);
-    /* detach this thread from its process */
-    /* note: curproc cannot be used after this call */
-  proc_remthread(curthread);
-  /* if this is the last user process in the system, proc_destroy()
-        will wake up the kernel menu thread */
-  proc_destroy(p);
+  // Hand the rest over to the parent to reap, if it's still around;
+  // otherwise we have to destroy it ourselves.
+  if (!proc_set_exit_status(p, exitcode, type)) {
+    /* if this is the last user process in the system, proc_destroy()
+       will wake up the kernel menu thread */
+    proc_destroy(p);
   }
   thread_exit();
   /* thread_exit() does not return, so we should never get here */
@@ -106,6 +90,7 @@ sys_waitpid(pid_t pid,
 {
   int exitstatus;
   int result;
+  pid_t childpid;
 
   // Check if the status is not null
   if (status == NULL) {
@@ -113,46 +98,60 @@ sys_waitpid(pid_t pid,
   }
 
   // Check to make sure unsuported options are not requested
-  if (options != 0) {
+  if ((options & ~WNOHANG) != 0) {
     return(EINVAL);
   }
 
   // ADDED STUFF:
 
-  struct proc * child_proc = proc_find_child(curproc, pid);
-
-  // Current process does not exist (exited a while ago or never existed)
-  if (child_proc == NULL) {
-    return waitpid_interested_error(pid);
+  // pid -1 means any child; proc_wait_child reaps the child, so it can
+  // only be waited for once.
+  result = proc_wait_child(curproc, pid, (options & WNOHANG) != 0,
+                           &exitstatus, &childpid);
+  if (result) {
+    return result;
   }
 
-  lock_acquire(child_proc->proc_exit_lock);
-
-  // Assume process exists and is the child of the current process
-  if(!child_proc->proc_exited) {
-    cv_wait(child_proc->proc_exit_cv, child_proc->proc_exit_lock);
-  }
-  exitstatus = child_proc->proc_exit_status;
-  lock_release(child_proc->proc_exit_lock);
-  result = copyout((void *)&exitstatus,status,sizeof(int));
-  if (result) {
-    return(result);
+  // With WNOHANG, childpid is 0 if no child was ready.
+  if (childpid != 0) {
+    result = copyout((void *)&exitstatus,status,sizeof(int));
+    if (result) {
+      return(result);
+    }
   }
   
   // END ADDED STUFF:
 
-  *retval = pid;
+  *retval = childpid;
   return(0);
 
 }
 
+/**
+ * Returns the resource usage of the calling process, or of its
+ * children that have been waited for.
+ */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+  struct rusage ru;
+  int result;
+
+  result = proc_getrusage(curproc, who, &ru);
+  if (result) {
+    return result;
+  }
+  return copyout(&ru, usage, sizeof(ru));
+}
+
 /**
  * Begin Added code: 
  */
 
 void forked_child_thread_entry(void * ptr, unsigned long val);
 void forked_child_thread_entry(void * ptr, unsigned long val) {
-  (void)val;
+  // The child keeps the id of the thread that forked it
+  curthread->t_tid = val;
   as_activate();
   KASSERT(ptr != NULL);
   struct trapframe * tf = ptr; 
@@ -166,6 +165,7 @@ int sys_fork(struct trapframe * tf, pid_t * retval) {
   int result = 0;
   struct proc * child_proc;
   struct trapframe * parent_tf;
+  pid_t child_pid;
 
   // Copying the parent's trapframe
   parent_tf = kmalloc(sizeof(struct trapframe));
@@ -174,149 +174,284 @@ int sys_fork(struct trapframe * tf, pid_t * retval) {
   }
   *parent_tf = *tf;
 
-  // Disabling ALL interrupts to fork safely
-  int spl = splhigh();
+  // No need to turn interrupts off: proc_fork copies the address space
+  // before the child is linked in anywhere, and the child can't run
+  // until thread_fork, which takes care of its own locking.
   child_proc = proc_fork(curproc);
   if (child_proc == NULL) {
     kfree(parent_tf);
-    splx(spl);
     return ENOMEM; 
   }
+  // Once the child runs, it could exit and be reaped by another of our
+  // threads before thread_fork even returns, so get its pid now.
+  child_pid = child_proc->pid;
+
       // Creating child thread using thread_fork
   result = thread_fork
     (curthread->t_name, child_proc, &forked_child_thread_entry,
-    (void*)parent_tf, (unsigned long)curproc->p_addrspace);
-  
-  // can enable interrupts now
-  splx(spl); 
+    (void*)parent_tf, (unsigned long)curthread->t_tid);
 
   if (result) {
+    if (child_proc->p_addrspace != NULL) {
+      as_destroy(child_proc->p_addrspace);
+      child_proc->p_addrspace = NULL;
+    }
     proc_destroy(child_proc);
     kfree(parent_tf);
     return result;
   }
   // Parent returns with child’s pid immediately
-  *retval = child_proc->pid;
+  *retval = child_pid;
   return(0);
 }
 
 
 
 int sys_execv(userptr_t progname_ptr, userptr_t args_ptr){
+  struct argbuf args;
+  char *prog_name;
+  struct addrspace *as, *oldas;
+  struct vnode *v;
+  vaddr_t entrypoint, stackptr;
+  userptr_t uargv;
+  int argc, result;
+  bool alone;
 
-  char* prog_name = kmalloc(PATH_MAX); 
-  size_t prog_name_len;
   if((char*)progname_ptr == NULL || (char**)args_ptr == NULL){
     return EFAULT;
   }
-  int argc = 0;
-  char** args_ptrs = kmalloc(ARG_MAX);
-        while(1){
-                char* arg = NULL;
-                copyin(args_ptr+argc*sizeof(char*), &arg, sizeof(char*));
-    args_ptrs[argc] = arg;
-    if(arg != NULL){
-      argc++;
-    }else{
-      break;
-    }
+
+  // Any other threads would go on running in the address space we're
+  // about to destroy, so refuse. Only a thread of this process can
+  // create another, so if we're alone now we stay alone.
+  lock_acquire(curproc->p_threadlock);
+  alone = curproc->p_nuthreads == 1;
+  lock_release(curproc->p_threadlock);
+  if (!alone) {
+    return EBUSY;
+  }
+
+  prog_name = kmalloc(PATH_MAX);
+  if (prog_name == NULL) {
+    return ENOMEM;
   }
-  if(argc> 64){
-    return E2BIG;
+  result = copyinstr(progname_ptr, prog_name, PATH_MAX, NULL);
+  if (result) {
+    kfree(prog_name);
+    return result;
   }
 
-  int result_prog_name = copyinstr(progname_ptr,prog_name,PATH_MAX, &prog_name_len);
-  if(result_prog_name != 0){
-    return result_prog_name;
+  // The arguments have to be copied in before the old address space
+  // goes away; see argv.c.
+  result = argbuf_copyin(&args, args_ptr);
+  if (result) {
+    kfree(prog_name);
+    return result;
   }
 
-  char* argv = kmalloc(ARG_MAX);
-  size_t * arg_offsets = kmalloc(argc * sizeof(size_t));
-        int offset = 0;
-  for(int i = 0; i < argc; i++){
-    //char* arg = kmalloc(ARG_MAX);
-    size_t arg_len;
-    int result = copyinstr((userptr_t)args_ptrs[i],
-         argv+offset, ARG_MAX - offset, &arg_len );
-    if(result != 0){
-      return result;
-    }
-    arg_offsets[i] = offset;
-    offset += ROUNDUP(arg_len+1,8);
-    //argv[i] = arg;
+  /* Open the file. */
+  result = vfs_open(prog_name, O_RDONLY, 0, &v);
+  if (result) {
+    goto fail_args;
   }
 
-  // prog_name (char*)   AND   argv (char*)
+  /* Create a new address space. */
+  as = as_create();
+  if (as == NULL) {
+    vfs_close(v);
+    result = ENOMEM;
+    goto fail_args;
+  }
+  /* Switch to it and activate it, keeping the old one until we're sure. */
+  oldas = curproc_setas(as);
+  as_activate();
 
-  struct addrspace *curproc_as = curproc_getas();
-  
+  /* Load the executable. */
+  result = load_elf(v, &entrypoint);
+  /* Done with the file now. */
+  vfs_close(v);
+  if (result) {
+    goto fail_as;
+  }
+
+  /* Define the user stack in the address space, and put argv on it */
+  result = as_define_stack(as, &stackptr);
+  if (result) {
+    goto fail_as;
+  }
+  result = argbuf_copyout(&args, &stackptr, &uargv);
+  if (result) {
+    goto fail_as;
+  }
+  argc = args.ab_argc;
+
+  // No going back now.
+  as_destroy(oldas);
+  argbuf_cleanup(&args);
+  kfree(prog_name);
+
+  enter_new_process(argc, uargv, stackptr, entrypoint);
+  /* enter_new_process does not return. */
+  panic("enter_new_process returned\n");
+  return EINVAL;
+
+ fail_as:
+  // Go back to the old address space, so we can return the error.
+  curproc_setas(oldas);
+  as_activate();
+  as_destroy(as);
+ fail_args:
+  argbuf_cleanup(&args);
+  kfree(prog_name);
+  return result;
+}
+
+
+
+/*
+ * spawn: start a new child process running the program PROGNAME with
+ * arguments ARGS, the way fork followed by execv in the child would,
+ * but without copying our address space only for execv to throw it
+ * away.
+ *
+ * We copy the path and arguments in, create the child process, and
+ * give it a thread that loads the program into a fresh address space
+ * of its own. We wait for it to get that far, so that if the program
+ * can't be run spawn fails with the reason, like execv would; in that
+ * case the child cleans itself up without ever having existed as far
+ * as anyone else can tell.
+ */
+struct spawn_args {
+  char *sa_path;
+  struct argbuf sa_args;
+  struct semaphore *sa_done;	// V'd once the child has loaded, or failed
+  int sa_result;
+};
+
+static
+void
+spawn_child_entry(void *ptr, unsigned long junk)
+{
+  struct spawn_args *sa = ptr;
+  struct proc *p = curproc;
   struct addrspace *as;
   struct vnode *v;
   vaddr_t entrypoint, stackptr;
-  vaddr_t cur_ptr;
-  int result;
+  userptr_t uargv;
+  int argc, result;
+
+  (void)junk;
+
   /* Open the file. */
-  result = vfs_open(prog_name, O_RDONLY, 0, &v);
+  result = vfs_open(sa->sa_path, O_RDONLY, 0, &v);
   if (result) {
-    return result;
+    goto fail;
   }
 
-  /* Create a new address space. */
+  /* Create a new address space, switch to it and load the executable. */
   as = as_create();
-  if (as ==NULL) {
+  if (as == NULL) {
     vfs_close(v);
-    return ENOMEM;
+    result = ENOMEM;
+    goto fail;
   }
-  /* Switch to it and activate it. */
   curproc_setas(as);
   as_activate();
-  /* Load the executable. */
   result = load_elf(v, &entrypoint);
+  vfs_close(v);
   if (result) {
-    /* p_addrspace will go away when curproc is destroyed */
-    vfs_close(v);
-    return result;
+    goto fail;
   }
-  /* Done with the file now. */
-  vfs_close(v);
-  /* Define the user stack in the address space */
-  result = as_define_stack(as, &stackptr);
 
-  // Have both argc and prog_name ready for runprogram
-  cur_ptr = stackptr;
-  cur_ptr -= offset;
-  result = copyout(argv, (userptr_t)cur_ptr, offset);
-  if(result != 0){
-    return result;
+  result = as_define_stack(as, &stackptr);
+  if (result) {
+    goto fail;
   }
+  result = argbuf_copyout(&sa->sa_args, &stackptr, &uargv);
+  if (result) {
+    goto fail;
+  }
+  argc = sa->sa_args.ab_argc;
+
+  // sa belongs to the parent, and may be gone once we V.
+  sa->sa_result = 0;
+  V(sa->sa_done);
 
-  userptr_t * arg_offsets_up = kmalloc(sizeof(userptr_t) * (argc+1));
-  for(int i = 0; i < argc; i++){
-    userptr_t ptr = (userptr_t)cur_ptr +  arg_offsets[i];
-    arg_offsets_up[i] = ptr;
+  enter_new_process(argc, uargv, stackptr, entrypoint);
+  /* enter_new_process does not return. */
+  panic("enter_new_process returned\n");
+
+ fail:
+  as = curproc_setas(NULL);
+  if (as != NULL) {
+    as_deactivate();
+    as_destroy(as);
   }
-  arg_offsets_up[argc] = NULL;
+  proc_remthread(curthread);
+  proc_destroy(p);
+  sa->sa_result = result;
+  V(sa->sa_done);
+  thread_exit();
+}
 
-  cur_ptr -= sizeof(userptr_t) * (argc+1);
+int
+sys_spawn(userptr_t progname_ptr, userptr_t args_ptr, pid_t *retval)
+{
+  struct spawn_args sa;
+  struct proc *child_proc;
+  pid_t child_pid;
+  int result;
 
-  result = copyout(arg_offsets_up, (userptr_t)cur_ptr, sizeof(userptr_t) * (argc+1) );
+  if (progname_ptr == NULL || args_ptr == NULL) {
+    return EFAULT;
+  }
 
-  if(result != 0){
+  sa.sa_path = kmalloc(PATH_MAX);
+  if (sa.sa_path == NULL) {
+    return ENOMEM;
+  }
+  result = copyinstr(progname_ptr, sa.sa_path, PATH_MAX, NULL);
+  if (result) {
+    kfree(sa.sa_path);
     return result;
   }
+  result = argbuf_copyin(&sa.sa_args, args_ptr);
+  if (result) {
+    kfree(sa.sa_path);
+    return result;
+  }
+  sa.sa_done = sem_create("spawn", 0);
+  if (sa.sa_done == NULL) {
+    result = ENOMEM;
+    goto out;
+  }
 
-  as_destroy(curproc_as);
-  kfree(arg_offsets);
-  kfree(arg_offsets_up);
-  kfree(argv);
-  kfree(args_ptrs);
-  kfree(prog_name);
+  child_proc = proc_create_runprogram(sa.sa_path);
+  if (child_proc == NULL) {
+    result = ENOMEM;
+    goto out;
+  }
+  // As in fork, the child could be gone by the time we'd look.
+  child_pid = child_proc->pid;
 
-  enter_new_process(argc /*argc*/, (userptr_t)cur_ptr /*userspace addr of argv*/,
-  cur_ptr, entrypoint);
-  /* enter_new_process does not return. */
-  panic("enter_new_process returned\n");
-  return EINVAL;
+  result = thread_fork(sa.sa_path, child_proc, &spawn_child_entry,
+                       &sa, 0);
+  if (result) {
+    proc_destroy(child_proc);
+    goto out;
+  }
+
+  P(sa.sa_done);
+  result = sa.sa_result;
+  if (result == 0) {
+    *retval = child_pid;
+  }
 
-  //return 0;
+ out:
+  if (sa.sa_done != NULL) {
+    sem_destroy(sa.sa_done);
+  }
+  argbuf_cleanup(&sa.sa_args);
+  kfree(sa.sa_path);
+  return result;
 }
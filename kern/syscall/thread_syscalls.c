@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * User thread system calls.
+ *
+ * Extra threads in a user process share its address space and are
+ * scheduled by the kernel like any other thread, so they can run on
+ * several cpus at once. Each gets its own user stack (see
+ * as_define_threadstack) and an id, which is its index in the
+ * process's p_uthreads table.
+ *
+ * A thread exits with thread_exit, or by returning from its start
+ * function (the C library arranges that). Its status is kept until
+ * another thread collects it with thread_join. When the last thread
+ * exits, the process exits with that thread's status. When any
+ * thread calls _exit, the whole process exits: the other threads
+ * are made to exit the next time they come into the kernel, which a
+ * thread running in user mode is made to do with an interprocessor
+ * interrupt, and _exit waits for them first. (A thread blocked in a
+ * system call finishes it first, except that futex_wait and waitpid
+ * give up.)
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/wait.h>
+#include <lib.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <synch.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* What a new thread needs to get to user mode. */
+struct uthread_args {
+	vaddr_t ua_start;		/* Where to start */
+	vaddr_t ua_func;		/* Passed to it in a0 */
+	vaddr_t ua_arg;			/* Passed to it in a1 */
+	vaddr_t ua_stack;		/* Initial stack pointer */
+	int ua_tid;
+};
+
+/*
+ * Finish off the current thread: take it out of the process, record
+ * STATUS for thread_join, and exit. Called with p_threadlock held.
+ */
+static
+void
+uthread_die(int status)
+{
+	struct proc *p = curproc;
+	struct uthread *ut = &p->p_uthreads[curthread->t_tid];
+
+	KASSERT(lock_do_i_hold(p->p_threadlock));
+	KASSERT(ut->ut_used && !ut->ut_exited);
+
+	ut->ut_exited = true;
+	ut->ut_status = status;
+	KASSERT(p->p_nuthreads > 1);
+	p->p_nuthreads--;
+	proc_remthread(curthread);
+	cv_broadcast(p->p_threadcv, p->p_threadlock);
+	lock_release(p->p_threadlock);
+
+	thread_exit();
+}
+
+/*
+ * Called on the way back to user mode when curproc->p_exiting is set,
+ * by a thread other than the one that called _exit.
+ */
+void
+uthread_exiting(void)
+{
+	lock_acquire(curproc->p_threadlock);
+	uthread_die(0);
+}
+
+/*
+ * Called by _exit before it tears the process down: get every other
+ * thread to exit, and wait until they have.
+ */
+void
+uthread_exitall(void)
+{
+	struct proc *p = curproc;
+	struct thread *t;
+	unsigned i;
+
+	lock_acquire(p->p_threadlock);
+	if (p->p_exiting) {
+		/* Another thread got here first; it does the exiting. */
+		uthread_die(0);
+	}
+	p->p_exiting = true;
+
+	/* Get anyone in thread_join, futex_wait or waitpid out of it. */
+	cv_broadcast(p->p_threadcv, p->p_threadlock);
+	futex_exiting();
+	proc_wait_interrupt(p);
+
+	while (p->p_nuthreads > 1) {
+		/*
+		 * Interrupt the ones in user mode, so that they come into
+		 * the kernel and see p_exiting. (Whether a thread is
+		 * running is only a hint, but if it's not it's in the
+		 * kernel, and will see p_exiting on the way out.)
+		 */
+		spinlock_acquire(&p->p_lock);
+		for (i=0; i<threadarray_num(&p->p_threads); i++) {
+			t = threadarray_get(&p->p_threads, i);
+			if (t != curthread && t->t_state == S_RUN) {
+				ipi_send(t->t_cpu, IPI_UNIDLE);
+			}
+		}
+		spinlock_release(&p->p_lock);
+
+		cv_wait(p->p_threadcv, p->p_threadlock);
+	}
+	lock_release(p->p_threadlock);
+}
+
+/*
+ * Start a new thread in user mode.
+ */
+static
+void
+uthread_entry(void *vargs, unsigned long junk)
+{
+	struct uthread_args args = *(struct uthread_args *)vargs;
+
+	(void)junk;
+	kfree(vargs);
+
+	curthread->t_tid = args.ua_tid;
+	if (curproc->p_exiting) {
+		uthread_exiting();
+	}
+
+	as_activate();
+	enter_new_thread(args.ua_start, args.ua_func, args.ua_arg,
+			 args.ua_stack);
+}
+
+/*
+ * Create a new thread in the current process. It starts at START with
+ * FUNC and ARG as its first two arguments. Returns the new thread's
+ * id.
+ */
+int
+sys___thread_create(userptr_t start, userptr_t func, userptr_t arg,
+		    int *retval)
+{
+	struct proc *p = curproc;
+	struct uthread_args *args;
+	struct uthread *ut;
+	int tid, result;
+
+	args = kmalloc(sizeof(*args));
+	if (args == NULL) {
+		return ENOMEM;
+	}
+
+	/* Find a free id; id 0 is only ever the first thread. */
+	lock_acquire(p->p_threadlock);
+	for (tid=1; tid<PROC_MAXTHREADS; tid++) {
+		if (!p->p_uthreads[tid].ut_used) {
+			break;
+		}
+	}
+	if (tid == PROC_MAXTHREADS || p->p_exiting) {
+		lock_release(p->p_threadlock);
+		kfree(args);
+		return EAGAIN;
+	}
+	ut = &p->p_uthreads[tid];
+	ut->ut_used = true;
+	ut->ut_exited = false;
+	ut->ut_joining = false;
+	ut->ut_status = 0;
+	p->p_nuthreads++;
+	lock_release(p->p_threadlock);
+
+	result = as_define_threadstack(curproc_getas(), tid, &args->ua_stack);
+	if (result) {
+		goto fail;
+	}
+	args->ua_start = (vaddr_t)start;
+	args->ua_func = (vaddr_t)func;
+	args->ua_arg = (vaddr_t)arg;
+	args->ua_tid = tid;
+
+	result = thread_fork(curthread->t_name, p, uthread_entry, args, 0);
+	if (result) {
+		goto fail;
+	}
+
+	*retval = tid;
+	return 0;
+
+ fail:
+	lock_acquire(p->p_threadlock);
+	ut->ut_used = false;
+	p->p_nuthreads--;
+	lock_release(p->p_threadlock);
+	kfree(args);
+	return result;
+}
+
+/*
+ * Wait for thread TID of the current process to exit, and collect its
+ * exit status. Only one thread can wait for a given thread.
+ */
+int
+sys_thread_join(int tid, userptr_t status)
+{
+	struct proc *p = curproc;
+	struct uthread *ut;
+	int exitstatus;
+
+	if (tid < 0 || tid >= PROC_MAXTHREADS) {
+		return ESRCH;
+	}
+	if (tid == curthread->t_tid) {
+		return EINVAL;
+	}
+
+	lock_acquire(p->p_threadlock);
+	ut = &p->p_uthreads[tid];
+	if (!ut->ut_used) {
+		lock_release(p->p_threadlock);
+		return ESRCH;
+	}
+	if (ut->ut_joining) {
+		lock_release(p->p_threadlock);
+		return EINVAL;
+	}
+
+	ut->ut_joining = true;
+	while (!ut->ut_exited && !p->p_exiting) {
+		cv_wait(p->p_threadcv, p->p_threadlock);
+	}
+	ut->ut_joining = false;
+	if (!ut->ut_exited) {
+		/* The process is exiting; we won't get back to user mode. */
+		lock_release(p->p_threadlock);
+		return EINTR;
+	}
+	exitstatus = ut->ut_status;
+	ut->ut_used = false;
+	lock_release(p->p_threadlock);
+
+	if (status != NULL) {
+		return copyout(&exitstatus, status, sizeof(int));
+	}
+	return 0;
+}
+
+/*
+ * Exit the current thread. If it's the last one, the process exits.
+ */
+void
+sys_thread_exit(int status)
+{
+	struct proc *p = curproc;
+
+	lock_acquire(p->p_threadlock);
+	if (p->p_nuthreads == 1 && !p->p_exiting) {
+		lock_release(p->p_threadlock);
+		sys__exit(status, __WEXITED);
+	}
+	uthread_die(status);
+}
@@ -28,8 +28,11 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
 #include <clock.h>
 #include <copyinout.h>
+#include <sharedpage.h>
 #include <syscall.h>
 
 /*
@@ -44,6 +47,9 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	gettime(&seconds, &nanoseconds);
 
+	/* Might as well bring the shared page's clock up to date too. */
+	sharedpage_tick();
+
 	result = copyout(&seconds, user_seconds_ptr, sizeof(time_t));
 	if (result) {
 		return result;
@@ -56,3 +62,35 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the time given in *REQ. We always sleep the full time,
+ * so if REM is given it's just zeroed.
+ */
+int
+sys_nanosleep(userptr_t req, userptr_t rem)
+{
+	struct timespec ts;
+	int result;
+
+	result = copyin(req, &ts, sizeof(ts));
+	if (result) {
+		return result;
+	}
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	clocknanosleep(ts.tv_sec, ts.tv_nsec);
+
+	if (rem != NULL) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+		result = copyout(&ts, rem, sizeof(ts));
+		if (result) {
+			return result;
+		}
+	}
+
+	return 0;
+}
@@ -43,8 +43,10 @@
 #include <kern/fcntl.h>
 #include <lib.h>
 #include <uio.h>
+#include <clock.h>
 #include <thread.h>
 #include <synch.h>
+#include <threadpool.h>
 #include <vfs.h>
 #include <fs.h>
 #include <vnode.h>
@@ -298,24 +300,27 @@ dofstest(const char *filesys)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * The readers are run by the kernel thread pool rather than forking
+ * a thread each; the time taken is printed so runs with different
+ * numbers of cpus can be compared.
+ */
 static
 void
-readstress_thread(void *fs, unsigned long num)
+readstress_one(void *fs, unsigned long num)
 {
 	const char *filesys = fs;
 	if (fstest_read(filesys, "")) {
-		kprintf("*** Thread %lu: failed\n", num);
+		kprintf("*** Reader %lu: failed\n", num);
 	}
-	V(threadsem);
 }
 
 static
 void
 doreadstress(const char *filesys)
 {
-	int i, err;
-
-	init_threadsem();
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
 
 	kprintf("*** Starting fs read stress test on %s:\n", filesys);
 
@@ -324,18 +329,12 @@ doreadstress(const char *filesys)
 		return;
 	}
 
-	for (i=0; i<NTHREADS; i++) {
-		err = thread_fork("readstress", NULL,
-				  readstress_thread, (char *)filesys, i);
-		if (err) {
-			panic("readstress: thread_fork failed: %s\n",
-			      strerror(err));
-		}
-	}
-
-	for (i=0; i<NTHREADS; i++) {
-		P(threadsem);
-	}
+	gettime(&secs1, &nsecs1);
+	parallel_for(NTHREADS, readstress_one, (char *)filesys);
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+	kprintf("*** %d readers took %lu.%03lu seconds\n", NTHREADS,
+		(unsigned long)secs2, (unsigned long)(nsecs2 / 1000000));
 
 	if (fstest_remove(filesys, "")) {
 		kprintf("*** Test failed\n");
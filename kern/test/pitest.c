@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Priority inversion test.
+ *
+ * A low-priority thread takes a lock and holds it for PI_HOLDMS
+ * milliseconds of wall time. A pack of medium-priority hog threads,
+ * at least one per cpu, then spin for up to PI_HOGMS, and finally a
+ * high-priority thread tries to get the lock. Without priority
+ * inheritance the holder can't run while the hogs do, so the
+ * high-priority thread waits until the hogs give up; with it, the
+ * holder runs at high priority until it lets go, and the wait is
+ * about PI_HOLDMS.
+ *
+ * This is done once with the high-priority thread waiting directly
+ * behind the holder, and once with a second low-priority thread in
+ * between (it holds the lock the high one wants, and is itself
+ * waiting for the first), so the priority has to be passed along
+ * the chain.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define PI_HOLDMS	50	/* How long the first holder keeps its lock */
+#define PI_HOGMS	2000	/* How long the hogs run, at most */
+#define PI_MAXDEPTH	2	/* Holders in the longest chain */
+
+#define PI_LOW		PRI_MIN
+#define PI_MEDIUM	(PRI_MIN + 1)
+#define PI_HIGH		PRI_MAX
+
+static struct lock *pi_locks[PI_MAXDEPTH];
+static struct semaphore *pi_heldsem;
+static struct semaphore *pi_donesem;
+static volatile bool pi_stop;
+static volatile uint64_t pi_waitms;
+
+static
+uint64_t
+pi_ms_since(time_t secs1, uint32_t nsecs1)
+{
+	time_t secs2;
+	uint32_t nsecs2;
+
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+	return (uint64_t)secs2 * 1000 + nsecs2 / 1000000;
+}
+
+/*
+ * Holder NUM takes lock NUM. The first one then keeps it for
+ * PI_HOLDMS; the others wait for the one before them.
+ */
+static
+void
+pi_holder(void *junk, unsigned long num)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	(void)junk;
+
+	thread_setpriority(PI_LOW);
+	lock_acquire(pi_locks[num]);
+	V(pi_heldsem);
+
+	if (num == 0) {
+		gettime(&secs, &nsecs);
+		while (pi_ms_since(secs, nsecs) < PI_HOLDMS) {
+			/* spin */
+		}
+	}
+	else {
+		lock_acquire(pi_locks[num - 1]);
+		lock_release(pi_locks[num - 1]);
+	}
+
+	lock_release(pi_locks[num]);
+	V(pi_donesem);
+}
+
+static
+void
+pi_hog(void *junk, unsigned long num)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PI_MEDIUM);
+	gettime(&secs, &nsecs);
+	while (!pi_stop && pi_ms_since(secs, nsecs) < PI_HOGMS) {
+		/* spin */
+	}
+	V(pi_donesem);
+}
+
+static
+void
+pi_waiter(void *junk, unsigned long depth)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	(void)junk;
+
+	thread_setpriority(PI_HIGH);
+	gettime(&secs, &nsecs);
+	lock_acquire(pi_locks[depth - 1]);
+	pi_waitms = pi_ms_since(secs, nsecs);
+	lock_release(pi_locks[depth - 1]);
+
+	/* Let the hogs go so we don't sit around waiting for them. */
+	pi_stop = true;
+	V(pi_donesem);
+}
+
+static
+void
+pi_fork(const char *name, void (*func)(void *, unsigned long),
+	unsigned long num)
+{
+	int result;
+
+	result = thread_fork(name, NULL, func, NULL, num);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+}
+
+/*
+ * Run one round with a chain of DEPTH holders. Returns true if the
+ * high-priority thread got the lock in reasonable time.
+ */
+static
+bool
+pirun(unsigned long depth, unsigned long nhogs)
+{
+	unsigned long i;
+	bool ok;
+
+	pi_stop = false;
+	pi_waitms = 0;
+
+	for (i=0; i<depth; i++) {
+		pi_fork("pitest holder", pi_holder, i);
+		P(pi_heldsem);
+	}
+	for (i=0; i<nhogs; i++) {
+		pi_fork("pitest hog", pi_hog, i);
+	}
+	pi_fork("pitest waiter", pi_waiter, depth);
+
+	for (i=0; i<depth + nhogs + 1; i++) {
+		P(pi_donesem);
+	}
+
+	/* Allow for a few scheduler ticks on top of the hold time. */
+	ok = pi_waitms < PI_HOLDMS + PI_HOGMS / 4;
+	kprintf("pitest: chain of %lu: waited %llu ms for the lock "
+		"(held for %d ms) %s\n", depth, pi_waitms, PI_HOLDMS,
+		ok ? "" : "-- priority inversion!");
+	return ok;
+}
+
+int
+pitest(int nargs, char **args)
+{
+	unsigned long nhogs = 8, depth;
+	bool ok = true;
+	char name[16];
+
+	if (nargs > 1) {
+		nhogs = atoi(args[1]);
+	}
+	if (nargs > 2 || nhogs == 0) {
+		kprintf("Usage: pi [hogs]\n");
+		kprintf("(Use at least as many hogs as there are cpus.)\n");
+		return EINVAL;
+	}
+
+	for (depth=0; depth<PI_MAXDEPTH; depth++) {
+		snprintf(name, sizeof(name), "pitest%lu", depth);
+		pi_locks[depth] = lock_create(name);
+		if (pi_locks[depth] == NULL) {
+			panic("pitest: lock_create failed\n");
+		}
+	}
+	pi_heldsem = sem_create("pi_heldsem", 0);
+	pi_donesem = sem_create("pi_donesem", 0);
+	if (pi_heldsem == NULL || pi_donesem == NULL) {
+		panic("pitest: sem_create failed\n");
+	}
+
+	kprintf("Starting priority inheritance test with %lu hogs...\n",
+		nhogs);
+	for (depth=1; depth<=PI_MAXDEPTH; depth++) {
+		ok = pirun(depth, nhogs) && ok;
+	}
+
+	sem_destroy(pi_donesem);
+	sem_destroy(pi_heldsem);
+	for (depth=0; depth<PI_MAXDEPTH; depth++) {
+		lock_destroy(pi_locks[depth]);
+	}
+	if (!ok) {
+		kprintf("Priority inheritance test FAILED.\n");
+		return ETIMEDOUT;
+	}
+	kprintf("Priority inheritance test done.\n");
+
+	return 0;
+}
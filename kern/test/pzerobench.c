@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Parallel zeroing benchmark.
+ *
+ * Zeroes the same block of kernel memory a number of times, first
+ * with plain bzero and then with parallel_bzero, and reports how long
+ * each took. This is the work dumbvm does for every new address
+ * space, so it shows what the thread pool buys exec and fork on this
+ * many cpus.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <vm.h>
+#include <threadpool.h>
+#include <test.h>
+
+static
+uint64_t
+pzbrun(void (*zero)(void *, size_t), void *block, size_t len,
+       unsigned long loops)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	unsigned long i;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<loops; i++) {
+		zero(block, len);
+	}
+	gettime(&secs2, &nsecs2);
+
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+	return (uint64_t)secs2 * 1000000 + nsecs2 / 1000;
+}
+
+int
+pzerobench(int nargs, char **args)
+{
+	unsigned long npages = 64, loops = 20;
+	uint64_t serial, parallel;
+	vaddr_t block;
+	size_t len;
+
+	if (nargs > 1) {
+		npages = atoi(args[1]);
+	}
+	if (nargs > 2) {
+		loops = atoi(args[2]);
+	}
+	if (nargs > 3 || npages == 0 || loops == 0) {
+		kprintf("Usage: pzb [pages [loops]]\n");
+		return EINVAL;
+	}
+
+	block = alloc_kpages(npages);
+	if (block == 0) {
+		kprintf("pzerobench: Out of memory\n");
+		return ENOMEM;
+	}
+	len = npages * PAGE_SIZE;
+
+	kprintf("Starting parallel zeroing benchmark: %lu pages, "
+		"%lu loops...\n", npages, loops);
+	serial = pzbrun(bzero, (void *)block, len, loops);
+	parallel = pzbrun(parallel_bzero, (void *)block, len, loops);
+	kprintf("bzero:          %llu us\n", serial);
+	kprintf("parallel_bzero: %llu us\n", parallel);
+	if (parallel > 0) {
+		kprintf("speedup:        %llu.%02llu\n", serial / parallel,
+			(serial * 100 / parallel) % 100);
+	}
+
+	free_kpages(block);
+	kprintf("Parallel zeroing benchmark done.\n");
+
+	return 0;
+}
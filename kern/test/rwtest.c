@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Reader-writer lock test.
+ *
+ * For 1, 2, ... N reader threads, each reader takes the lock for
+ * reading in a loop and checks that the data it protects is
+ * consistent, while one writer thread keeps changing it. Reports the
+ * total read throughput, which should grow with the number of
+ * readers (up to the number of cpus) if readers aren't serializing
+ * each other.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NREADLOOPS	2000
+#define NREADHOLD	200
+#define NWRITEHOLD	20
+
+static struct rwlock *testrw;
+static struct semaphore *rwdonesem;
+static volatile unsigned long rwval1;
+static volatile unsigned long rwval2;
+static volatile bool rwreadersdone;
+static volatile bool rwfailed;
+
+static
+void
+rwreaderthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NREADLOOPS; i++) {
+		rwlock_acquire_read(testrw);
+		for (j=0; j<NREADHOLD; j++);
+		if (rwval1 != rwval2) {
+			rwfailed = true;
+		}
+		rwlock_release_read(testrw);
+	}
+	V(rwdonesem);
+}
+
+static
+void
+rwwriterthread(void *junk, unsigned long num)
+{
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	while (!rwreadersdone) {
+		rwlock_acquire_write(testrw);
+		rwval1++;
+		for (j=0; j<NWRITEHOLD; j++);
+		rwval2++;
+		rwlock_release_write(testrw);
+
+		/* Let the readers at it for a while. */
+		clocknanosleep(0, 1000000);
+	}
+	V(rwdonesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, n, maxreaders, result;
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	uint64_t usecs;
+
+	maxreaders = 4;
+	if (nargs == 2) {
+		maxreaders = atoi(args[1]);
+	}
+	if (nargs > 2 || maxreaders < 1) {
+		kprintf("Usage: sy5 [maxreaders]\n");
+		return EINVAL;
+	}
+
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	rwdonesem = sem_create("rwdonesem", 0);
+	if (rwdonesem == NULL) {
+		panic("rwtest: sem_create failed\n");
+	}
+	rwval1 = rwval2 = 0;
+	rwfailed = false;
+
+	kprintf("Starting rwlock test...\n");
+	kprintf("readers  reads/ms\n");
+
+	for (n=1; n<=maxreaders; n++) {
+		rwreadersdone = false;
+		result = thread_fork("rwwriter", NULL, rwwriterthread,
+				     NULL, 0);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+
+		gettime(&secs1, &nsecs1);
+		for (i=0; i<n; i++) {
+			result = thread_fork("rwreader", NULL, rwreaderthread,
+					     NULL, i);
+			if (result) {
+				panic("rwtest: thread_fork failed: %s\n",
+				      strerror(result));
+			}
+		}
+		for (i=0; i<n; i++) {
+			P(rwdonesem);
+		}
+		gettime(&secs2, &nsecs2);
+
+		rwreadersdone = true;
+		P(rwdonesem);
+
+		getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+		usecs = (uint64_t)secs2 * 1000000 + nsecs2 / 1000;
+		kprintf("%7d  %8llu\n", n,
+			usecs == 0 ? 0 :
+			(uint64_t)n * NREADLOOPS * 1000 / usecs);
+	}
+
+	sem_destroy(rwdonesem);
+	rwlock_destroy(testrw);
+
+	if (rwfailed) {
+		kprintf("rwlock test FAILED: reader saw a partial write\n");
+		return EIO;
+	}
+	kprintf("rwlock test done.\n");
+
+	return 0;
+}
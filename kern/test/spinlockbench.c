@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Spinlock benchmark.
+ *
+ * Like the stc spinlock thread counter, a number of threads bump a
+ * shared counter under a spinlock. This is run twice: once with an
+ * old-style test-and-test-and-set lock on one word, and once with
+ * struct spinlock, which is a ticket lock. For each it reports the
+ * throughput and the longest any one acquire had to wait; the ticket
+ * lock should show a much lower worst case under contention, since
+ * it serves waiters in order.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define SLB_HOLD	20	/* Loop iterations with the lock held */
+
+static volatile spinlock_data_t slb_ttas = SPINLOCK_DATA_INITIALIZER;
+static struct spinlock slb_ticket = SPINLOCK_INITIALIZER;
+static struct semaphore *slb_donesem;
+static volatile unsigned long slb_counter;
+static volatile uint64_t slb_maxwait;	/* Protected by the lock under test */
+static unsigned long slb_loops;
+static bool slb_useticket;
+
+/*
+ * The test-and-test-and-set lock spinlock_acquire used to use.
+ */
+static
+int
+ttas_acquire(void)
+{
+	int spl;
+
+	spl = splhigh();
+	while (spinlock_data_get(&slb_ttas) != 0 ||
+	       spinlock_data_testandset(&slb_ttas) != 0) {
+		/* spin */
+	}
+	return spl;
+}
+
+static
+void
+ttas_release(int spl)
+{
+	spinlock_data_set(&slb_ttas, 0);
+	splx(spl);
+}
+
+static
+void
+slbthread(void *junk, unsigned long num)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	uint64_t wait;
+	unsigned long i;
+	int spl = 0;
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<slb_loops; i++) {
+		gettime(&secs1, &nsecs1);
+		if (slb_useticket) {
+			spinlock_acquire(&slb_ticket);
+		}
+		else {
+			spl = ttas_acquire();
+		}
+		gettime(&secs2, &nsecs2);
+
+		getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+		wait = (uint64_t)secs2 * 1000000000 + nsecs2;
+		if (wait > slb_maxwait) {
+			slb_maxwait = wait;
+		}
+		slb_counter++;
+		for (j=0; j<SLB_HOLD; j++);
+
+		if (slb_useticket) {
+			spinlock_release(&slb_ticket);
+		}
+		else {
+			ttas_release(spl);
+		}
+	}
+
+	V(slb_donesem);
+}
+
+static
+void
+slbrun(const char *name, bool useticket, unsigned long nthreads)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	uint64_t usecs;
+	unsigned long i;
+	int result;
+
+	slb_useticket = useticket;
+	slb_counter = 0;
+	slb_maxwait = 0;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("spinlockbench", NULL, slbthread,
+				     NULL, i);
+		if (result) {
+			panic("spinlockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(slb_donesem);
+	}
+	gettime(&secs2, &nsecs2);
+
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+	usecs = (uint64_t)secs2 * 1000000 + nsecs2 / 1000;
+
+	kprintf("%-6s %10llu %12llu %s\n", name,
+		usecs == 0 ? 0 : (uint64_t)slb_counter * 1000 / usecs,
+		slb_maxwait / 1000,
+		slb_counter == nthreads * slb_loops ? "" : "(count wrong!)");
+}
+
+int
+spinlockbench(int nargs, char **args)
+{
+	unsigned long nthreads = 8;
+
+	slb_loops = 1000;
+	if (nargs > 1) {
+		nthreads = atoi(args[1]);
+	}
+	if (nargs > 2) {
+		slb_loops = atoi(args[2]);
+	}
+	if (nargs > 3 || nthreads == 0 || slb_loops == 0) {
+		kprintf("Usage: slb [threads [loops]]\n");
+		return EINVAL;
+	}
+
+	slb_donesem = sem_create("slb_donesem", 0);
+	if (slb_donesem == NULL) {
+		panic("spinlockbench: sem_create failed\n");
+	}
+
+	kprintf("Starting spinlock benchmark: %lu threads, %lu loops...\n",
+		nthreads, slb_loops);
+	kprintf("%-6s %10s %12s\n", "lock", "acq/ms", "maxwait us");
+	slbrun("ttas", false, nthreads);
+	slbrun("ticket", true, nthreads);
+
+	sem_destroy(slb_donesem);
+	kprintf("Spinlock benchmark done.\n");
+
+	return 0;
+}
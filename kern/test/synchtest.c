@@ -32,6 +32,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
@@ -42,6 +43,8 @@
 #define NLOCKLOOPS    120
 #define NCVLOOPS      1
 #define NTHREADS      10
+#define NBENCHLOOPS   2000
+#define NBENCHHOLD    200
 
 static volatile unsigned long testval1;
 static volatile unsigned long testval2;
@@ -315,6 +318,8 @@ cvtest(int nargs, char **args)
 {
 
 	int i, result;
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
 
 	(void)nargs;
 	(void)args;
@@ -329,6 +334,7 @@ cvtest(int nargs, char **args)
 
 	testval1 = NTHREADS-1;
 
+	gettime(&secs1, &nsecs1);
 	for (i=0; i<NTHREADS; i++) {
 		result = thread_fork("synchtest", NULL, cvtestthread, NULL, i);
 		if (result) {
@@ -339,11 +345,113 @@ cvtest(int nargs, char **args)
 	for (i=0; i<NTHREADS; i++) {
 		P(donesem);
 	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
 
 #ifdef UW
   cleanitems();
 #endif
-	kprintf("CV test done\n");
+	kprintf("CV test done (%lu.%03lu seconds)\n", (unsigned long)secs2,
+		(unsigned long)(nsecs2 / 1000000));
+
+	return 0;
+}
+
+/*
+ * Lock contention benchmark.
+ *
+ * For 1, 2, ... N threads, have each thread take and drop a lock in a
+ * loop with a short critical section, and report the average time
+ * lock_acquire took. The scheduler spreads the threads over the cpus,
+ * so up to the number of cpus this shows how acquire latency grows
+ * with the number of cpus contending.
+ */
+
+static struct lock *benchlock;
+static struct semaphore *benchdonesem;
+static uint64_t benchwait;
+
+static
+void
+lockbenchthread(void *junk, unsigned long num)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	uint64_t waited = 0;
+	int i;
+	volatile int j;		/* so the hold loops aren't optimized out */
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NBENCHLOOPS; i++) {
+		gettime(&secs1, &nsecs1);
+		lock_acquire(benchlock);
+		gettime(&secs2, &nsecs2);
+		getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+		waited += (uint64_t)secs2 * 1000000000 + nsecs2;
+
+		for (j=0; j<NBENCHHOLD; j++);
+
+		lock_release(benchlock);
+
+		/* Give the others a chance at it. */
+		for (j=0; j<NBENCHHOLD; j++);
+	}
+
+	lock_acquire(benchlock);
+	benchwait += waited;
+	lock_release(benchlock);
+
+	V(benchdonesem);
+}
+
+int
+lockbench(int nargs, char **args)
+{
+	int i, n, maxthreads, result;
+
+	maxthreads = 4;
+	if (nargs == 2) {
+		maxthreads = atoi(args[1]);
+	}
+	if (nargs > 2 || maxthreads < 1) {
+		kprintf("Usage: sy4 [maxthreads]\n");
+		return EINVAL;
+	}
+
+	benchlock = lock_create("benchlock");
+	if (benchlock == NULL) {
+		panic("lockbench: lock_create failed\n");
+	}
+	benchdonesem = sem_create("benchdonesem", 0);
+	if (benchdonesem == NULL) {
+		panic("lockbench: sem_create failed\n");
+	}
+
+	kprintf("Starting lock contention benchmark...\n");
+	kprintf("threads  avg acquire (ns)\n");
+
+	for (n=1; n<=maxthreads; n++) {
+		benchwait = 0;
+		for (i=0; i<n; i++) {
+			result = thread_fork("lockbench", NULL,
+					     lockbenchthread, NULL, i);
+			if (result) {
+				panic("lockbench: thread_fork failed: %s\n",
+				      strerror(result));
+			}
+		}
+		for (i=0; i<n; i++) {
+			P(benchdonesem);
+		}
+		kprintf("%7d  %16llu\n", n,
+			benchwait / ((uint64_t)n * NBENCHLOOPS));
+	}
+
+	sem_destroy(benchdonesem);
+	lock_destroy(benchlock);
+	kprintf("Lock contention benchmark done.\n");
 
 	return 0;
 }
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+/*
+ * Task queue test.
+ *
+ * Checks that tasks queued on a cpu run there, in order, in the task
+ * thread at PRI_MAX, and that queueing a task that is still waiting
+ * to run does nothing. Then checks that callouts, which run from a
+ * task, still wake clocknanosleep roughly on time.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <clock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <taskq.h>
+#include <test.h>
+
+#define TQT_NTASKS	8
+#define TQT_NSLEEPS	20
+#define TQT_SLEEPNS	5000000		/* 5 ms */
+#define TQT_SLACKNS	50000000	/* 50 ms; allowed lateness */
+
+static struct task tqt_tasks[TQT_NTASKS];
+static struct semaphore *tqt_donesem;
+static unsigned tqt_order[TQT_NTASKS];
+static volatile unsigned tqt_ran;
+static volatile bool tqt_failed;
+static struct cpu *tqt_cpu;
+
+static
+void
+tqt_task(void *junk, unsigned long num)
+{
+	(void)junk;
+
+	if (curcpu->c_self != tqt_cpu || curthread->t_pri != PRI_MAX ||
+	    tqt_ran == TQT_NTASKS) {
+		tqt_failed = true;
+	}
+	else {
+		tqt_order[tqt_ran++] = num;
+	}
+	V(tqt_donesem);
+}
+
+int
+taskqtest(int nargs, char **args)
+{
+	time_t secs, secs2;
+	uint32_t nsecs, nsecs2;
+	uint64_t late, maxlate;
+	unsigned i;
+	int spl;
+	bool ok = true;
+
+	(void)nargs;
+	(void)args;
+
+	tqt_donesem = sem_create("tqt_donesem", 0);
+	if (tqt_donesem == NULL) {
+		panic("taskqtest: sem_create failed\n");
+	}
+	for (i=0; i<TQT_NTASKS; i++) {
+		task_init(&tqt_tasks[i], tqt_task, NULL, i);
+	}
+	tqt_ran = 0;
+	tqt_failed = false;
+
+	kprintf("Starting task queue test...\n");
+
+	/*
+	 * With interrupts off we can't be switched away from this cpu,
+	 * and the task thread can't run, so everything is still queued
+	 * when we queue task 0 the second time.
+	 */
+	spl = splhigh();
+	tqt_cpu = curcpu->c_self;
+	for (i=0; i<TQT_NTASKS; i++) {
+		if (!taskq_enqueue(&tqt_tasks[i])) {
+			ok = false;
+		}
+	}
+	if (taskq_enqueue(&tqt_tasks[0])) {
+		kprintf("taskqtest: queued a task twice\n");
+		ok = false;
+	}
+	splx(spl);
+
+	for (i=0; i<TQT_NTASKS; i++) {
+		P(tqt_donesem);
+	}
+	if (tqt_ran != TQT_NTASKS) {
+		kprintf("taskqtest: %u tasks ran, expected %d\n",
+			tqt_ran, TQT_NTASKS);
+		ok = false;
+	}
+	for (i=0; i<tqt_ran; i++) {
+		if (tqt_order[i] != i) {
+			kprintf("taskqtest: tasks ran out of order\n");
+			ok = false;
+			break;
+		}
+	}
+	if (tqt_failed) {
+		kprintf("taskqtest: task ran on the wrong cpu, "
+			"at the wrong priority, or too often\n");
+		ok = false;
+	}
+
+	maxlate = 0;
+	for (i=0; i<TQT_NSLEEPS; i++) {
+		gettime(&secs, &nsecs);
+		clocknanosleep(0, TQT_SLEEPNS);
+		gettime(&secs2, &nsecs2);
+		getinterval(secs, nsecs, secs2, nsecs2, &secs, &nsecs);
+		late = secs * 1000000000ULL + nsecs;
+		if (late < TQT_SLEEPNS) {
+			kprintf("taskqtest: clocknanosleep returned early\n");
+			ok = false;
+			break;
+		}
+		late -= TQT_SLEEPNS;
+		if (late > maxlate) {
+			maxlate = late;
+		}
+	}
+	kprintf("taskqtest: %d sleeps of %d us, at most %llu us late\n",
+		TQT_NSLEEPS, TQT_SLEEPNS / 1000, maxlate / 1000);
+	if (maxlate > TQT_SLACKNS) {
+		ok = false;
+	}
+
+	sem_destroy(tqt_donesem);
+
+	if (!ok) {
+		kprintf("Task queue test FAILED.\n");
+		return EIO;
+	}
+	kprintf("Task queue test done.\n");
+
+	return 0;
+}
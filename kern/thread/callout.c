@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Callouts, kept in a hierarchical timing wheel.
+ *
+ * Level 0 of the wheel has one slot per tick (CALLOUT_USECS). Each
+ * slot of level N covers a whole revolution of level N-1. A callout
+ * goes in the lowest level whose span reaches its due time; when the
+ * wheel comes around to a higher-level slot, its callouts are moved
+ * ("cascaded") down. Anything beyond the span of the top level is
+ * parked in the furthest slot it can reach and cascaded again until
+ * it gets there. Scheduling and cancelling are thus constant time.
+ *
+ * Rather than running the wheel off a periodic interrupt, we program
+ * the timer device for the next nonempty level-0 slot, or the next
+ * point where level 1 needs cascading, whichever is sooner. With
+ * nothing pending, the timer isn't programmed at all.
+ *
+ * Everything is protected by callout_lock, which is dropped while
+ * each callout function runs.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <callout.h>
+
+/* Wheel geometry */
+#define WHEEL_LEVELS	4
+#define WHEEL_BITS0	8			/* 256 ticks at level 0 */
+#define WHEEL_BITSN	6			/* 64 slots above that */
+#define WHEEL_SLOTS0	(1U << WHEEL_BITS0)
+#define WHEEL_SLOTSN	(1U << WHEEL_BITSN)
+
+/* Position of level L's (L >= 1) slot index within a tick number */
+#define WHEEL_SHIFT(l)	(WHEEL_BITS0 + ((l) - 1) * WHEEL_BITSN)
+
+/* Number of ticks levels 0 through L together reach ahead */
+#define WHEEL_SPAN(l)	((uint64_t)1 << (WHEEL_BITS0 + (l) * WHEEL_BITSN))
+
+/* "Timer not programmed" value for callout_nextfire */
+#define NEVER		((uint64_t)-1)
+
+/*
+ * The slots. Each is a circular list with a dummy callout as its
+ * head; only the link fields of the dummies are used.
+ */
+static struct callout wheel0[WHEEL_SLOTS0];
+static struct callout wheeln[WHEEL_LEVELS - 1][WHEEL_SLOTSN];
+
+static struct spinlock callout_lock = SPINLOCK_INITIALIZER;
+static uint64_t wheel_now;		/* Next tick to be processed */
+static uint64_t callout_nextfire;	/* Tick the timer is set for */
+static unsigned callout_count;		/* Number of pending callouts */
+static bool callout_running;		/* Someone's in callout_run */
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Get the current time, both in ticks (returned) and in microseconds
+ * (in *USECS). The wheel's idea of "now" starts from the first time
+ * anyone asks.
+ */
+static
+uint64_t
+callout_now(uint64_t *usecs)
+{
+	time_t secs;
+	uint32_t nsecs;
+	uint64_t now;
+
+	gettime(&secs, &nsecs);
+	*usecs = (uint64_t)secs * 1000000 + nsecs / 1000;
+	now = *usecs / CALLOUT_USECS;
+	if (wheel_now == 0) {
+		wheel_now = now;
+	}
+	return now;
+}
+
+static
+void
+callout_link(struct callout *head, struct callout *co)
+{
+	co->co_prev = head->co_prev;
+	co->co_next = head;
+	head->co_prev->co_next = co;
+	head->co_prev = co;
+}
+
+static
+void
+callout_unlink(struct callout *co)
+{
+	KASSERT(co->co_pending);
+	co->co_prev->co_next = co->co_next;
+	co->co_next->co_prev = co->co_prev;
+	co->co_next = co->co_prev = NULL;
+	co->co_pending = false;
+	callout_count--;
+}
+
+/*
+ * Put a callout in the right slot for its due time relative to
+ * wheel_now. Does not count it; used both for new callouts and for
+ * cascading.
+ */
+static
+void
+callout_insert(struct callout *co)
+{
+	uint64_t expires, delta;
+	unsigned level;
+
+	expires = co->co_expires;
+	if (expires < wheel_now) {
+		/* Overdue; run it the next time the wheel turns. */
+		expires = wheel_now;
+	}
+	delta = expires - wheel_now;
+
+	if (delta < WHEEL_SLOTS0) {
+		callout_link(&wheel0[expires & (WHEEL_SLOTS0 - 1)], co);
+		return;
+	}
+
+	for (level = 1; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < WHEEL_SPAN(level)) {
+			break;
+		}
+	}
+	if (delta >= WHEEL_SPAN(level)) {
+		/* Too far out even for the top level; park it. */
+		expires = wheel_now + WHEEL_SPAN(level) - 1;
+	}
+	callout_link(&wheeln[level - 1][(expires >> WHEEL_SHIFT(level))
+					& (WHEEL_SLOTSN - 1)], co);
+}
+
+/*
+ * Move everything in one higher-level slot down to where it now
+ * belongs.
+ */
+static
+void
+callout_cascade_slot(struct callout *head)
+{
+	struct callout *co;
+
+	while ((co = head->co_next) != head) {
+		co->co_prev->co_next = co->co_next;
+		co->co_next->co_prev = co->co_prev;
+		callout_insert(co);
+	}
+}
+
+/*
+ * Called when level 0 wraps around at wheel_now: cascade the level 1
+ * slot that's now current, and so on up as each level wraps in turn.
+ */
+static
+void
+callout_cascade(void)
+{
+	unsigned level, index;
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		index = (wheel_now >> WHEEL_SHIFT(level)) & (WHEEL_SLOTSN - 1);
+		callout_cascade_slot(&wheeln[level - 1][index]);
+		if (index != 0) {
+			break;
+		}
+	}
+}
+
+/*
+ * Program the timer for the next time the wheel needs to turn, if
+ * that's sooner than it's already set for. NOWUSECS is the current
+ * time in microseconds.
+ */
+static
+void
+callout_settimer(uint64_t nowusecs)
+{
+	uint64_t next, fireusecs;
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&callout_lock));
+
+	if (callout_count == 0) {
+		return;
+	}
+
+	next = wheel_now + WHEEL_SLOTS0;
+	for (i=0; i<WHEEL_SLOTS0; i++) {
+		if (i > 0 && ((wheel_now + i) & (WHEEL_SLOTS0 - 1)) == 0) {
+			/* Level 1 needs cascading here */
+			next = wheel_now + i;
+			break;
+		}
+		if (wheel0[(wheel_now + i) & (WHEEL_SLOTS0 - 1)].co_next !=
+		    &wheel0[(wheel_now + i) & (WHEEL_SLOTS0 - 1)]) {
+			next = wheel_now + i;
+			break;
+		}
+	}
+
+	if (next >= callout_nextfire) {
+		return;
+	}
+	callout_nextfire = next;
+
+	fireusecs = next * CALLOUT_USECS;
+	timerclock_set(fireusecs > nowusecs ?
+		       (uint32_t)(fireusecs - nowusecs) : 1);
+}
+
+////////////////////////////////////////////////////////////
+
+void
+callout_bootstrap(void)
+{
+	unsigned i, j;
+
+	for (i=0; i<WHEEL_SLOTS0; i++) {
+		wheel0[i].co_next = wheel0[i].co_prev = &wheel0[i];
+	}
+	for (i=0; i<WHEEL_LEVELS - 1; i++) {
+		for (j=0; j<WHEEL_SLOTSN; j++) {
+			wheeln[i][j].co_next = &wheeln[i][j];
+			wheeln[i][j].co_prev = &wheeln[i][j];
+		}
+	}
+	wheel_now = 0;
+	callout_nextfire = NEVER;
+	callout_count = 0;
+	callout_running = false;
+}
+
+void
+callout_init(struct callout *co, void (*func)(void *), void *arg)
+{
+	co->co_next = co->co_prev = NULL;
+	co->co_expires = 0;
+	co->co_pending = false;
+	co->co_func = func;
+	co->co_arg = arg;
+}
+
+void
+callout_reset(struct callout *co, time_t secs, uint32_t nsecs)
+{
+	uint64_t nowusecs, dueusecs;
+
+	KASSERT(secs >= 0);
+	KASSERT(nsecs < 1000000000);
+
+	spinlock_acquire(&callout_lock);
+
+	if (co->co_pending) {
+		callout_unlink(co);
+	}
+
+	callout_now(&nowusecs);
+	dueusecs = nowusecs + (uint64_t)secs * 1000000
+		+ DIVROUNDUP(nsecs, 1000);
+	co->co_expires = DIVROUNDUP(dueusecs, CALLOUT_USECS);
+	if (callout_running && co->co_expires <= wheel_now) {
+		/*
+		 * The wheel_now slot is being drained; putting this in
+		 * it, e.g. a callout re-arming itself with no delay,
+		 * would keep callout_run there forever.
+		 */
+		co->co_expires = wheel_now + 1;
+	}
+	callout_insert(co);
+	co->co_pending = true;
+	callout_count++;
+
+	/* If callout_run is going, it'll set the timer when done. */
+	if (!callout_running) {
+		callout_settimer(nowusecs);
+	}
+
+	spinlock_release(&callout_lock);
+}
+
+bool
+callout_stop(struct callout *co)
+{
+	bool ret;
+
+	spinlock_acquire(&callout_lock);
+	ret = co->co_pending;
+	if (ret) {
+		callout_unlink(co);
+	}
+	spinlock_release(&callout_lock);
+
+	return ret;
+}
+
+bool
+callout_pending(struct callout *co)
+{
+	bool ret;
+
+	spinlock_acquire(&callout_lock);
+	ret = co->co_pending;
+	spinlock_release(&callout_lock);
+
+	return ret;
+}
+
+/*
+ * Turn the wheel up to the present, calling everything that's due.
+ */
+void
+callout_run(void)
+{
+	uint64_t now, nowusecs;
+	struct callout *head, *co;
+	void (*func)(void *);
+	void *arg;
+
+	spinlock_acquire(&callout_lock);
+
+	/* Only one cpu at a time turns the wheel. */
+	if (callout_running) {
+		spinlock_release(&callout_lock);
+		return;
+	}
+	callout_running = true;
+	callout_nextfire = NEVER;
+
+	now = callout_now(&nowusecs);
+	if (callout_count == 0 && wheel_now < now) {
+		/* Nothing to do; don't bother stepping through. */
+		wheel_now = now;
+	}
+
+	while (wheel_now <= now) {
+		if ((wheel_now & (WHEEL_SLOTS0 - 1)) == 0) {
+			callout_cascade();
+		}
+		head = &wheel0[wheel_now & (WHEEL_SLOTS0 - 1)];
+		while ((co = head->co_next) != head) {
+			callout_unlink(co);
+			func = co->co_func;
+			arg = co->co_arg;
+
+			/* The callout may be gone once this returns. */
+			spinlock_release(&callout_lock);
+			func(arg);
+			spinlock_acquire(&callout_lock);
+		}
+		wheel_now++;
+	}
+
+	callout_running = false;
+	callout_settimer(nowusecs);
+
+	spinlock_release(&callout_lock);
+}
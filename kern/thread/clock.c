@@ -30,10 +30,17 @@
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spinlock.h>
+#include <threadlist.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <proc.h>
+#include <mainbus.h>
+#include <callout.h>
+#include <taskq.h>
+#include <sharedpage.h>
 
 /*
  * Time handling.
@@ -51,12 +58,27 @@
  * the scheduler.
  */
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
-#define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * The device that calls timerclock(), and how to program it.
  */
-static struct wchan *lbolt;
+static void *timerclock_dev;
+static void (*timerclock_settimer)(void *devdata, uint32_t usecs);
+
+/*
+ * Threads in clocknanosleep() wait on one of a few wait channels,
+ * picked by hashing the thread pointer, so a wakeup only disturbs
+ * the handful of sleepers that share a channel.
+ */
+#define SLEEPCHANS	16
+static struct wchan *sleepchans[SLEEPCHANS];
+
+/*
+ * The callout wheel is turned by a task rather than in the timer
+ * interrupt itself; see timerclock().
+ */
+static struct task timerclock_task;
+static void timerclock_run(void *, unsigned long);
 
 /*
  * Setup.
@@ -64,26 +86,76 @@ static struct wchan *lbolt;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	unsigned i;
+
+	for (i=0; i<SLEEPCHANS; i++) {
+		sleepchans[i] = wchan_create("clocksleep");
+		if (sleepchans[i] == NULL) {
+			panic("Couldn't create clocksleep wchans\n");
+		}
 	}
+	task_init(&timerclock_task, timerclock_run, NULL, 0);
+	callout_bootstrap();
+}
+
+/*
+ * Called by the timer device to hook itself up. SETTIMER must arrange
+ * for one call to timerclock() the given number of microseconds from
+ * now, replacing any earlier request.
+ */
+void
+timerclock_attach(void *devdata, void (*settimer)(void *, uint32_t))
+{
+	KASSERT(timerclock_settimer == NULL);
+	timerclock_dev = devdata;
+	timerclock_settimer = settimer;
+}
+
+void
+timerclock_set(uint32_t usecs)
+{
+	if (timerclock_settimer != NULL) {
+		timerclock_settimer(timerclock_dev, usecs);
+	}
+}
+
+static
+void
+timerclock_run(void *junk1, unsigned long junk2)
+{
+	(void)junk1;
+	(void)junk2;
+
+	callout_run();
 }
 
 /*
- * This is called once per second, on one processor, by the timer
- * code.
+ * This is called on one processor by the timer code when the time
+ * last asked for with timerclock_set comes around.
+ *
+ * Turning the wheel can mean cascading a whole slot of callouts and
+ * then running them, which is more than should be done with the
+ * timer interrupt blocked, so queue it as a task on this cpu. The
+ * task thread runs at PRI_MAX, but nothing preempts on wakeup, so
+ * preempt for it now rather than leave it until the next hardclock.
+ * Until this cpu's task queue exists (early in boot) just do it here.
  */
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	wchan_wakeall(lbolt);
+	if (curcpu->c_taskq == NULL) {
+		callout_run();
+		return;
+	}
+	if (taskq_enqueue(&timerclock_task) && !curcpu->c_isidle &&
+	    curthread->t_pri < PRI_MAX) {
+		thread_preempt();
+	}
 }
 
 /*
  * This is called HZ times a second (on each processor) by the timer
- * code.
+ * code, except while the tick is switched off; see below.
  */
 void
 hardclock(void)
@@ -92,14 +164,201 @@ hardclock(void)
 	 * Collect statistics here as desired.
 	 */
 
+	if (!curcpu->c_isidle) {
+		if (curthread->t_userintr) {
+			curthread->t_ru.rc_uticks++;
+		}
+		else {
+			curthread->t_ru.rc_sticks++;
+		}
+	}
+
+	sharedpage_tick();
+
 	curcpu->c_hardclocks++;
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
-		thread_consider_migration();
+
+	/*
+	 * If there's nothing to switch to, don't bother yielding, and
+	 * stop the tick until there is.
+	 */
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	if (curcpu->c_isidle || threadlist_isempty(&curcpu->c_runqueue)) {
+		hardclock_stop();
+		spinlock_release(&curcpu->c_runqueue_lock);
+		return;
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	thread_preempt();
+}
+
+/*
+ * Dynamic ticks.
+ *
+ * A cpu that is idle or has only one runnable thread has no use for
+ * the periodic hardclock, as there's nothing to time-slice against.
+ * So the tick is switched off in those cases, and back on as soon as
+ * another thread is queued on the cpu. The hardclocks skipped while
+ * it was off are added to c_hardclocks on restart so that counter
+ * still measures time. The shared page counts the cpus with their
+ * tick off, as they no longer keep its clock up to date.
+ *
+ * Both functions operate on the current cpu and must be called with
+ * interrupts off. hardclock_stop must also be called with the run
+ * queue locked, so that other cpus queueing threads get a consistent
+ * view of c_tickstopped and know to send an IPI to restart it.
+ */
+void
+hardclock_stop(void)
+{
+	KASSERT(spinlock_do_i_hold(&curcpu->c_runqueue_lock));
+
+	/*
+	 * Until the first hardclock the timer and the clock device
+	 * aren't necessarily set up yet, so leave things alone.
+	 */
+	if (curcpu->c_tickstopped) {
+		/* thread_switch is about to idle */
+		if (curcpu->c_isidle) {
+			hardclock_setowner(NULL);
+		}
+		return;
+	}
+	if (curcpu->c_hardclocks == 0) {
+		return;
+	}
+
+	gettime(&curcpu->c_tickstop_secs, &curcpu->c_tickstop_nsecs);
+	curcpu->c_tickstopped = true;
+	mainbus_settimer(0);
+
+	curcpu->c_tickowner = curcpu->c_isidle ? NULL : curthread;
+	curcpu->c_tickcharged_secs = curcpu->c_tickstop_secs;
+	curcpu->c_tickcharged_nsecs = curcpu->c_tickstop_nsecs;
+	sharedpage_tickstopped(true);
+}
+
+void
+hardclock_start(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	if (!curcpu->c_tickstopped) {
+		return;
+	}
+
+	hardclock_setowner(NULL);
+	sharedpage_tickstopped(false);
+
+	gettime(&secs, &nsecs);
+	getinterval(curcpu->c_tickstop_secs, curcpu->c_tickstop_nsecs,
+		    secs, nsecs, &secs, &nsecs);
+	curcpu->c_hardclocks += secs * HZ + nsecs / (1000000000 / HZ);
+
+	curcpu->c_tickstopped = false;
+	mainbus_settimer(1);
+}
+
+/*
+ * Charge the time since the last call to the thread that was running,
+ * in ticks, rounded to the nearest so it averages out over many short
+ * runs. We don't know how much of it was in user mode, so it counts
+ * as user time for threads of user processes, which is mostly right:
+ * a thread that is in the kernel for long is usually asleep.
+ */
+void
+hardclock_setowner(struct thread *t)
+{
+	struct thread *owner;
+	time_t secs, isecs;
+	uint32_t nsecs, insecs, ticks;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	owner = curcpu->c_tickowner;
+	if (owner == NULL && t == NULL) {
+		return;
+	}
+
+	gettime(&secs, &nsecs);
+	if (owner != NULL) {
+		getinterval(curcpu->c_tickcharged_secs,
+			    curcpu->c_tickcharged_nsecs,
+			    secs, nsecs, &isecs, &insecs);
+		ticks = isecs * HZ +
+			(insecs + 500000000 / HZ) / (1000000000 / HZ);
+		if (owner->t_proc != NULL && owner->t_proc != kproc) {
+			owner->t_ru.rc_uticks += ticks;
+		}
+		else {
+			owner->t_ru.rc_sticks += ticks;
+		}
+	}
+	curcpu->c_tickowner = t;
+	curcpu->c_tickcharged_secs = secs;
+	curcpu->c_tickcharged_nsecs = nsecs;
+}
+
+/*
+ * Sleeping.
+ */
+struct clocksleeper {
+	struct wchan *cs_wchan;
+	struct thread *cs_thread;
+	volatile bool cs_done;
+};
+
+/*
+ * The channels are shared, so wake only the thread the callout is
+ * for. Once cs_done is set the sleeper may return, taking CS with it;
+ * but it can't before the channel is unlocked, and if it's asleep it
+ * can't until it's been woken.
+ */
+static
+void
+clocksleep_wakeup(void *data)
+{
+	struct clocksleeper *cs = data;
+	struct wchan *wc = cs->cs_wchan;
+
+	wchan_lock(wc);
+	cs->cs_done = true;
+	wchan_wakethread(wc, cs->cs_thread);
+}
+
+/*
+ * Suspend execution for SECS seconds plus NSECS nanoseconds.
+ */
+void
+clocknanosleep(time_t secs, uint32_t nsecs)
+{
+	struct clocksleeper cs;
+	struct callout co;
+
+	KASSERT(nsecs < 1000000000);
+
+	if (secs == 0 && nsecs == 0) {
+		return;
+	}
+
+	cs.cs_wchan = sleepchans[((vaddr_t)curthread >> 6) % SLEEPCHANS];
+	cs.cs_thread = curthread;
+	cs.cs_done = false;
+	callout_init(&co, clocksleep_wakeup, &cs);
+	callout_reset(&co, secs, nsecs);
+
+	wchan_lock(cs.cs_wchan);
+	while (!cs.cs_done) {
+		wchan_sleep(cs.cs_wchan);
+		wchan_lock(cs.cs_wchan);
 	}
-	thread_yield();
+	wchan_unlock(cs.cs_wchan);
 }
 
 /*
@@ -108,9 +367,7 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-	while (num_secs > 0) {
-		wchan_lock(lbolt);
-		wchan_sleep(lbolt);
-		num_secs--;
+	if (num_secs > 0) {
+		clocknanosleep(num_secs, 0);
 	}
 }
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Lock statistics. See lockstat.h.
+ *
+ * Since this is called from inside spinlock_acquire and
+ * spinlock_release, it can't use spinlocks itself, or anything that
+ * does (kmalloc, kprintf). The table is instead protected by a bare
+ * test-and-set word, taken with interrupts off.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_SIZE		512	/* Table entries; power of 2 */
+#define LOCKSTAT_NAMELEN	20	/* Bytes of name kept */
+#define LOCKSTAT_MAXDUMP	32	/* Most lines lockstat_dump prints */
+
+struct lockstat_entry {
+	bool le_used;			/* Entry is in use */
+	bool le_live;			/* Lock hasn't been destroyed */
+	const void *le_lock;		/* Address of the lock */
+	unsigned le_kind;		/* LOCKSTAT_SPIN, etc. */
+	char le_name[LOCKSTAT_NAMELEN];
+	unsigned le_acquires;		/* Number of acquires */
+	unsigned le_contended;		/* Number that had to wait */
+	uint64_t le_spinns;		/* Total time spent spinning */
+	uint64_t le_sleepns;		/* Total time spent asleep */
+	uint64_t le_maxholdns;		/* Longest time held */
+};
+
+static struct lockstat_entry lockstat_table[LOCKSTAT_SIZE];
+static unsigned lockstat_overflows;	/* Locks not recorded */
+static volatile spinlock_data_t lockstat_lock = SPINLOCK_DATA_INITIALIZER;
+static volatile bool lockstat_enabled;
+
+/* Copy of the top entries for lockstat_dump to print. */
+static struct lockstat_entry lockstat_top[LOCKSTAT_MAXDUMP];
+
+static
+int
+lockstat_acquire(void)
+{
+	int spl;
+
+	spl = splhigh();
+	while (spinlock_data_get(&lockstat_lock) != 0 ||
+	       spinlock_data_testandset(&lockstat_lock) != 0) {
+		/* spin */
+	}
+	return spl;
+}
+
+static
+void
+lockstat_release(int spl)
+{
+	spinlock_data_set(&lockstat_lock, 0);
+	splx(spl);
+}
+
+/*
+ * Table entries are found by open addressing. An entry is empty
+ * (!le_used), live (le_live, keyed by le_lock), history for destroyed
+ * locks (!le_live, le_acquires > 0, keyed by le_kind and le_name), or
+ * free again (!le_live, le_acquires == 0). Free entries are reused,
+ * but lookups have to keep going past them.
+ */
+static
+bool
+lockstat_isfree(const struct lockstat_entry *le)
+{
+	return !le->le_live && le->le_acquires == 0;
+}
+
+/*
+ * Find the live entry for LOCK. If there isn't one and CREATE is
+ * set, make one; otherwise return NULL.
+ */
+static
+struct lockstat_entry *
+lockstat_find(const void *lock, bool create)
+{
+	struct lockstat_entry *le, *freele = NULL;
+	unsigned i, n;
+
+	i = ((uintptr_t)lock >> 2) * 2654435761U;
+	for (n=0; n<LOCKSTAT_SIZE; n++) {
+		le = &lockstat_table[(i + n) & (LOCKSTAT_SIZE - 1)];
+		if (!le->le_used) {
+			break;
+		}
+		if (le->le_live && le->le_lock == lock) {
+			return le;
+		}
+		if (freele == NULL && lockstat_isfree(le)) {
+			freele = le;
+		}
+	}
+	if (!create) {
+		return NULL;
+	}
+	if (freele == NULL) {
+		if (n == LOCKSTAT_SIZE) {
+			lockstat_overflows++;
+			return NULL;
+		}
+		freele = le;
+	}
+	bzero(freele, sizeof(*freele));
+	freele->le_used = true;
+	freele->le_live = true;
+	freele->le_lock = lock;
+	return freele;
+}
+
+/*
+ * Find, or make, the history entry for destroyed locks of kind KIND
+ * called NAME.
+ */
+static
+struct lockstat_entry *
+lockstat_findhistory(unsigned kind, const char *name)
+{
+	struct lockstat_entry *le, *freele = NULL;
+	unsigned i, n;
+
+	i = kind;
+	for (n=0; name[n] != '\0'; n++) {
+		i = i * 31 + (unsigned char)name[n];
+	}
+	i *= 2654435761U;
+
+	for (n=0; n<LOCKSTAT_SIZE; n++) {
+		le = &lockstat_table[(i + n) & (LOCKSTAT_SIZE - 1)];
+		if (!le->le_used) {
+			break;
+		}
+		if (!le->le_live && le->le_acquires > 0 &&
+		    le->le_kind == kind && !strcmp(le->le_name, name)) {
+			return le;
+		}
+		if (freele == NULL && lockstat_isfree(le)) {
+			freele = le;
+		}
+	}
+	if (freele == NULL) {
+		if (n == LOCKSTAT_SIZE) {
+			lockstat_overflows++;
+			return NULL;
+		}
+		freele = le;
+	}
+	bzero(freele, sizeof(*freele));
+	freele->le_used = true;
+	freele->le_kind = kind;
+	strcpy(freele->le_name, name);
+	return freele;
+}
+
+static
+uint64_t
+lockstat_waitns(const struct lockstat_entry *le)
+{
+	return le->le_spinns + le->le_sleepns;
+}
+
+////////////////////////////////////////////////////////////
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_enabled = true;
+}
+
+uint64_t
+lockstat_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (!lockstat_enabled) {
+		return 0;
+	}
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+void
+lockstat_acquired(const void *lock, unsigned kind, const char *name,
+		  bool contended, uint64_t spinns, uint64_t sleepns)
+{
+	struct lockstat_entry *le;
+	const char *s;
+	unsigned i;
+	int spl;
+
+	if (!lockstat_enabled) {
+		return;
+	}
+
+	spl = lockstat_acquire();
+	le = lockstat_find(lock, true);
+	if (le != NULL) {
+		if (le->le_acquires == 0) {
+			le->le_kind = kind;
+			/* Spinlocks go by __FILE__:__LINE__; drop the dirs */
+			for (s = name; kind == LOCKSTAT_SPIN && s != NULL &&
+				     *s != '\0'; s++) {
+				if (*s == '/') {
+					name = s + 1;
+				}
+			}
+			for (i=0; name != NULL && name[i] != '\0' &&
+				     i < LOCKSTAT_NAMELEN - 1; i++) {
+				le->le_name[i] = name[i];
+			}
+			le->le_name[i] = '\0';
+		}
+		le->le_acquires++;
+		if (contended) {
+			le->le_contended++;
+		}
+		le->le_spinns += spinns;
+		le->le_sleepns += sleepns;
+	}
+	lockstat_release(spl);
+}
+
+void
+lockstat_released(const void *lock, uint64_t holdns)
+{
+	struct lockstat_entry *le;
+	int spl;
+
+	if (!lockstat_enabled) {
+		return;
+	}
+
+	spl = lockstat_acquire();
+	le = lockstat_find(lock, false);
+	if (le != NULL && holdns > le->le_maxholdns) {
+		le->le_maxholdns = holdns;
+	}
+	lockstat_release(spl);
+}
+
+/*
+ * Add the counts for a destroyed lock to the history entry for its
+ * kind and name, and free its own entry.
+ */
+void
+lockstat_destroyed(const void *lock)
+{
+	struct lockstat_entry *le, *hist;
+	struct lockstat_entry old;
+	int spl;
+
+	if (!lockstat_enabled) {
+		return;
+	}
+
+	spl = lockstat_acquire();
+	le = lockstat_find(lock, false);
+	if (le != NULL) {
+		old = *le;
+		le->le_live = false;
+		le->le_lock = NULL;
+		le->le_acquires = 0;
+
+		if (old.le_acquires > 0) {
+			hist = lockstat_findhistory(old.le_kind, old.le_name);
+			if (hist != NULL) {
+				hist->le_acquires += old.le_acquires;
+				hist->le_contended += old.le_contended;
+				hist->le_spinns += old.le_spinns;
+				hist->le_sleepns += old.le_sleepns;
+				if (old.le_maxholdns > hist->le_maxholdns) {
+					hist->le_maxholdns = old.le_maxholdns;
+				}
+			}
+		}
+	}
+	lockstat_release(spl);
+}
+
+void
+lockstat_dump(unsigned max)
+{
+	static const char *const kindnames[] = { "spin", "lock", "sem", "cv" };
+	struct lockstat_entry *le;
+	unsigned i, j, ntop, overflows;
+	int spl;
+
+	if (max > LOCKSTAT_MAXDUMP) {
+		max = LOCKSTAT_MAXDUMP;
+	}
+
+	/*
+	 * Pick out the top entries by insertion sort into
+	 * lockstat_top, then print them once we've let go of the
+	 * table (kprintf takes spinlocks).
+	 */
+	ntop = 0;
+	spl = lockstat_acquire();
+	for (i=0; i<LOCKSTAT_SIZE; i++) {
+		le = &lockstat_table[i];
+		if (!le->le_used || le->le_acquires == 0) {
+			continue;
+		}
+		for (j = ntop; j > 0; j--) {
+			if (lockstat_waitns(&lockstat_top[j-1]) >=
+			    lockstat_waitns(le)) {
+				break;
+			}
+			if (j < max) {
+				lockstat_top[j] = lockstat_top[j-1];
+			}
+		}
+		if (j < max) {
+			lockstat_top[j] = *le;
+			if (ntop < max) {
+				ntop++;
+			}
+		}
+	}
+	overflows = lockstat_overflows;
+	lockstat_release(spl);
+
+	kprintf("%-20s %-4s %9s %9s %10s %10s %10s\n", "lock", "kind",
+		"acquires", "contended", "spin us", "sleep us", "maxhold us");
+	for (i=0; i<ntop; i++) {
+		le = &lockstat_top[i];
+		if (le->le_name[0] != '\0') {
+			kprintf("%-20s", le->le_name);
+		}
+		else if (le->le_live) {
+			kprintf("%-20p", le->le_lock);
+		}
+		else {
+			kprintf("%-20s", "(unnamed)");
+		}
+		kprintf(" %-4s %9u %9u %10llu %10llu %10llu%s\n",
+			kindnames[le->le_kind], le->le_acquires,
+			le->le_contended, le->le_spinns / 1000,
+			le->le_sleepns / 1000, le->le_maxholdns / 1000,
+			le->le_live ? "" : " (gone)");
+	}
+	if (overflows > 0) {
+		kprintf("lockstat: table full; %u locks not recorded\n",
+			overflows);
+	}
+}
@@ -35,6 +35,7 @@
 #include <cpu.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <lockstat.h>
 #include <current.h>	/* for curcpu */
 
 /*
@@ -43,15 +44,30 @@
 
 
 /*
- * Initialize spinlock.
+ * Initialize spinlock. (The parentheses get past the macro that,
+ * with lockstat, sends callers to spinlock_init_at instead.)
  */
 void
-spinlock_init(struct spinlock *lk)
+(spinlock_init)(struct spinlock *lk)
 {
-	spinlock_data_set(&lk->lk_lock, 0);
+	spinlock_data_set(&lk->lk_next, 0);
+	spinlock_data_set(&lk->lk_serving, 0);
 	lk->lk_holder = NULL;
+#if OPT_LOCKSTAT
+	lk->lk_acquired = 0;
+	lk->lk_name = NULL;
+#endif
 }
 
+#if OPT_LOCKSTAT
+void
+spinlock_init_at(struct spinlock *lk, const char *site)
+{
+	(spinlock_init)(lk);
+	lk->lk_name = site;
+}
+#endif
+
 /*
  * Clean up spinlock.
  */
@@ -60,21 +76,29 @@ spinlock_cleanup(struct spinlock *lk)
 {
 	//lk = NULL ;
 	KASSERT(lk->lk_holder == NULL);
-	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
-	//KASSERT ( spinlock_data_get ( &lk -> lk_lock ) == NULL ) ;
+	KASSERT(spinlock_data_get(&lk->lk_next) ==
+		spinlock_data_get(&lk->lk_serving));
+#if OPT_LOCKSTAT
+	lockstat_destroyed(lk);
+#endif
 }
 
 /*
  * Get the lock.
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
- * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * might come back to this lock and deadlock), then take a ticket with
+ * a machine-level atomic increment and wait for our turn.
  */
 void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket;
+#if OPT_LOCKSTAT
+	bool contended = false;
+	uint64_t start = 0;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -89,27 +113,28 @@ spinlock_acquire(struct spinlock *lk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&lk->lk_lock) != 0) {
-			continue;
+	/*
+	 * Waiting only reads lk_serving, and only the holder writes
+	 * it, once, on release; so there's much less bus traffic
+	 * than with everyone doing test-and-set on the same word.
+	 */
+	ticket = spinlock_data_fetchinc(&lk->lk_next);
+	while (spinlock_data_get(&lk->lk_serving) != ticket) {
+#if OPT_LOCKSTAT
+		if (!contended) {
+			contended = true;
+			start = lockstat_now();
 		}
-		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
-			continue;
-		}
-		break;
+#endif
 	}
 
 	lk->lk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	lk->lk_acquired = lockstat_now();
+	lockstat_acquired(lk, LOCKSTAT_SPIN, lk->lk_name, contended,
+			  contended ? lk->lk_acquired - start : 0, 0);
+#endif
 }
 
 /*
@@ -123,8 +148,15 @@ spinlock_release(struct spinlock *lk)
 		KASSERT(lk->lk_holder == curcpu->c_self);
 	}
 
+#if OPT_LOCKSTAT
+	if (lk->lk_acquired != 0) {
+		lockstat_released(lk, lockstat_now() - lk->lk_acquired);
+	}
+#endif
+
 	lk->lk_holder = NULL;
-	spinlock_data_set(&lk->lk_lock, 0);
+	spinlock_data_set(&lk->lk_serving,
+			  spinlock_data_get(&lk->lk_serving) + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -36,9 +36,11 @@
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -83,6 +85,9 @@ sem_destroy(struct semaphore *sem)
 	/* wchan_cleanup will assert if anyone's waiting on it */
 	spinlock_cleanup(&sem->sem_lock);
 	wchan_destroy(sem->sem_wchan);
+#if OPT_LOCKSTAT
+	lockstat_destroyed(sem);
+#endif
 
 	kfree(sem->sem_name);
 	kfree(sem);
@@ -91,6 +96,11 @@ sem_destroy(struct semaphore *sem)
 void 
 P(struct semaphore *sem)
 {
+#if OPT_LOCKSTAT
+	bool contended;
+	uint64_t start = 0;
+#endif
+
 	KASSERT(sem != NULL);
 
 	/*
@@ -102,6 +112,13 @@ P(struct semaphore *sem)
 	KASSERT(curthread->t_in_interrupt == false);
 
 	spinlock_acquire(&sem->sem_lock);
+
+#if OPT_LOCKSTAT
+	contended = sem->sem_count == 0;
+	if (contended) {
+		start = lockstat_now();
+	}
+#endif
 	
 	while (sem->sem_count == 0) {
 		/*
@@ -129,6 +146,10 @@ P(struct semaphore *sem)
 
 	KASSERT(sem->sem_count > 0);
 	sem->sem_count--;
+#if OPT_LOCKSTAT
+	lockstat_acquired(sem, LOCKSTAT_SEM, sem->sem_name, contended, 0,
+			  contended ? lockstat_now() - start : 0);
+#endif
 	spinlock_release(&sem->sem_lock);
 }
 
@@ -155,6 +176,7 @@ struct lock *
 lock_create(const char *name)
 {
 	struct lock *lock;
+	int i ;
 
 	lock = kmalloc(sizeof(struct lock));
 	if (lock == NULL) {
@@ -182,7 +204,15 @@ lock_create(const char *name)
 	}
 
 	lock -> lk_owner = NULL ;
+	for ( i = 0 ; i < NPRI ; i++ )
+	{
+		lock -> lk_waiters [ i ] = 0 ;
+	}
+	lock -> lk_nextheld = NULL ;
 	spinlock_init ( &lock -> lk_lock ) ;
+#if OPT_LOCKSTAT
+	lock -> lk_acquired = 0 ;
+#endif
 
 	// End of the added stuff
         
@@ -196,7 +226,11 @@ lock_destroy(struct lock *lock)
 
 	// add stuff here as needed
 
+	KASSERT ( lock -> lk_owner == NULL ) ;
 	spinlock_cleanup ( &lock -> lk_lock );
+#if OPT_LOCKSTAT
+	lockstat_destroyed ( lock ) ;
+#endif
 
 	if ( lock -> lk_wchan != NULL )
 	{
@@ -209,6 +243,123 @@ lock_destroy(struct lock *lock)
 	kfree(lock);
 }
 
+/*
+ * Adaptive locking: a lock is usually held only briefly, so if the
+ * holder is running on another cpu it's cheaper to spin until it
+ * lets go than to sleep and be woken again, which costs two context
+ * switches. If the holder isn't running it can't let go until it is,
+ * so there's no point spinning; likewise once LOCK_SPIN_MAX checks
+ * of the lock have gone by without it being released.
+ */
+#define LOCK_SPIN_MAX	1000
+
+/*
+ * Check if OWNER is running on some other cpu. This is only a hint;
+ * it can change as soon as it's been looked at. The caller must hold
+ * lk_lock, so that OWNER can't release the lock and go away.
+ */
+static
+bool
+lock_owner_running ( struct thread volatile *owner )
+{
+	return owner -> t_state == S_RUN && owner -> t_cpu != curcpu -> c_self ;
+}
+
+/*
+ * Priority inheritance. Each lock counts the threads sleeping on it
+ * at each priority, and each thread keeps a list of the locks it
+ * holds, so a thread's effective priority is the highest of its base
+ * priority and the top sleeper on any lock it holds. All of this,
+ * along with lk_owner changing hands, t_pri and t_blockedon, is
+ * protected by lock_pilock, which nests inside lk_lock.
+ */
+static struct spinlock lock_pilock = SPINLOCK_INITIALIZER ;
+
+/* Highest priority of anything sleeping on LOCK, or -1 if nothing is. */
+static
+int
+lock_waitpri ( struct lock *lock )
+{
+	int pri ;
+
+	for ( pri = PRI_MAX ; pri >= PRI_MIN ; pri-- )
+	{
+		if ( lock -> lk_waiters [ pri ] > 0 )
+		{
+			return pri ;
+		}
+	}
+	return -1 ;
+}
+
+/*
+ * Raise T to at least PRI. If T is itself asleep waiting for a lock,
+ * carry on to that lock's holder, and so on down the chain. (A
+ * deadlock cycle stops the walk once everyone on it is at PRI.)
+ */
+static
+void
+lock_inherit_boost ( struct thread *t , int pri )
+{
+	struct lock *lock ;
+
+	KASSERT ( spinlock_do_i_hold ( &lock_pilock ) ) ;
+
+	while ( t != NULL && t -> t_pri < pri )
+	{
+		lock = t -> t_blockedon ;
+		if ( lock != NULL )
+		{
+			KASSERT ( lock -> lk_waiters [ t -> t_pri ] > 0 ) ;
+			lock -> lk_waiters [ t -> t_pri ]-- ;
+			lock -> lk_waiters [ pri ]++ ;
+		}
+		t -> t_pri = pri ;
+
+		if ( lock == NULL )
+		{
+			break ;
+		}
+		t = ( struct thread * ) lock -> lk_owner ;
+	}
+}
+
+/*
+ * Recompute the current thread's priority from its base priority and
+ * the locks it still holds. It isn't waiting for a lock, so nobody
+ * further down a chain is affected.
+ */
+static
+void
+lock_inherit_recompute ( void )
+{
+	struct lock *held ;
+	int pri , waitpri ;
+
+	KASSERT ( spinlock_do_i_hold ( &lock_pilock ) ) ;
+	KASSERT ( curthread -> t_blockedon == NULL ) ;
+
+	pri = curthread -> t_basepri ;
+	for ( held = curthread -> t_heldlocks ; held != NULL ;
+	      held = held -> lk_nextheld )
+	{
+		waitpri = lock_waitpri ( held ) ;
+		if ( waitpri > pri )
+		{
+			pri = waitpri ;
+		}
+	}
+	curthread -> t_pri = pri ;
+}
+
+void
+lock_inherit_update ( void )
+{
+	spinlock_acquire ( &lock_pilock ) ;
+	lock_inherit_recompute ( ) ;
+	spinlock_release ( &lock_pilock ) ;
+}
+
 /* Get the lock. Only one thread can hold the lock at the
  * same time.
  */
@@ -217,6 +368,13 @@ lock_acquire(struct lock *lock)
 {
 	// Write this
 
+	struct thread volatile *owner ;
+	unsigned spins = 0 ;
+#if OPT_LOCKSTAT
+	bool contended ;
+	uint64_t start = 0 , slept = 0 , now ;
+#endif
+
 	KASSERT ( lock != NULL ) ;
 	KASSERT ( curthread -> t_in_interrupt == false ) ;
 
@@ -224,19 +382,75 @@ lock_acquire(struct lock *lock)
 
 	KASSERT ( ! ( lock_do_i_hold ( lock ) ) ) ;
 
+#if OPT_LOCKSTAT
+	contended = lock -> lk_owner != NULL ;
+	if ( contended )
+	{
+		start = lockstat_now ( ) ;
+	}
+#endif
+
 	while ( lock -> lk_owner != NULL )
 	{
+		owner = lock -> lk_owner ;
+
+		if ( spins < LOCK_SPIN_MAX && lock_owner_running ( owner ) )
+		{
+			/* Watch the lock without holding lk_lock. */
+			spinlock_release ( &lock -> lk_lock ) ;
+
+			while ( lock -> lk_owner == owner &&
+				spins < LOCK_SPIN_MAX )
+			{
+				spins++ ;
+			}
+
+			spinlock_acquire ( &lock -> lk_lock ) ;
+			continue ;
+		}
+
+#if OPT_LOCKSTAT
+		now = lockstat_now ( ) ;
+#endif
+		// Lend our priority to the holder while we sleep.
+		spinlock_acquire ( &lock_pilock ) ;
+		curthread -> t_blockedon = lock ;
+		lock -> lk_waiters [ curthread -> t_pri ]++ ;
+		lock_inherit_boost ( ( struct thread * ) owner , curthread -> t_pri ) ;
+		spinlock_release ( &lock_pilock ) ;
+
 		wchan_lock ( lock -> lk_wchan ) ;
 		spinlock_release ( &lock -> lk_lock ) ;
 
 		wchan_sleep ( lock -> lk_wchan ) ;
 
 		spinlock_acquire ( &lock -> lk_lock ) ;
+#if OPT_LOCKSTAT
+		slept += lockstat_now ( ) - now ;
+#endif
+
+		spinlock_acquire ( &lock_pilock ) ;
+		lock -> lk_waiters [ curthread -> t_pri ]-- ;
+		curthread -> t_blockedon = NULL ;
+		spinlock_release ( &lock_pilock ) ;
 	}
  
 	KASSERT ( lock -> lk_owner == NULL ) ;
 
+	// Anyone still asleep on the lock now waits behind us instead.
+	spinlock_acquire ( &lock_pilock ) ;
 	lock -> lk_owner = curthread ;
+	lock -> lk_nextheld = curthread -> t_heldlocks ;
+	curthread -> t_heldlocks = lock ;
+	lock_inherit_boost ( curthread , lock_waitpri ( lock ) ) ;
+	spinlock_release ( &lock_pilock ) ;
+
+#if OPT_LOCKSTAT
+	now = lockstat_now ( ) ;
+	lock -> lk_acquired = now ;
+	lockstat_acquired ( lock , LOCKSTAT_LOCK , lock -> lk_name , contended ,
+			    contended ? now - start - slept : 0 , slept ) ;
+#endif
 
 	spinlock_release ( &lock -> lk_lock ) ;
 
@@ -253,15 +467,50 @@ void
 lock_release(struct lock *lock)
 {
 	// Write this
+
+	struct lock **pp ;
+	int oldpri ;
+	bool lowered ;
 		
 	KASSERT ( lock != NULL ) ;
 
 	spinlock_acquire ( &lock -> lk_lock ) ;
 
+	KASSERT ( lock_do_i_hold ( lock ) ) ;
+
+#if OPT_LOCKSTAT
+	if ( lock -> lk_acquired != 0 )
+	{
+		lockstat_released ( lock , lockstat_now ( ) - lock -> lk_acquired ) ;
+	}
+#endif
+
+	// Take it off our list and give back what its sleepers lent us.
+	spinlock_acquire ( &lock_pilock ) ;
+	for ( pp = &curthread -> t_heldlocks ; *pp != lock ;
+	      pp = &( *pp ) -> lk_nextheld )
+	{
+		KASSERT ( *pp != NULL ) ;
+	}
+	*pp = lock -> lk_nextheld ;
+	lock -> lk_nextheld = NULL ;
 	lock -> lk_owner = NULL ;
+
+	oldpri = curthread -> t_pri ;
+	lock_inherit_recompute ( ) ;
+	lowered = curthread -> t_pri < oldpri ;
+	spinlock_release ( &lock_pilock ) ;
+
 	wchan_wakeone ( lock -> lk_wchan ) ;
 
 	spinlock_release ( &lock -> lk_lock ) ;
+
+	// If we were only running on borrowed priority, let whoever lent
+	// it have the cpu now, unless we can't switch here.
+	if ( lowered && curthread -> t_iplhigh_count == 0 )
+	{
+		thread_yield ( ) ;
+	}
 		
 	// End of the added stuff
 
@@ -348,6 +597,9 @@ cv_destroy(struct cv *cv)
     // add stuff here as needed
 
     wchan_destroy ( cv -> cv_wchan ) ;
+#if OPT_LOCKSTAT
+    lockstat_destroyed ( cv ) ;
+#endif
 
     // End of the added stuff
    
@@ -363,13 +615,30 @@ cv_wait(struct cv *cv, struct lock *lock)
 {
 	// Write this
 
+#if OPT_LOCKSTAT
+	uint64_t start ;
+#endif
+
 	KASSERT ( lock != NULL ) ;
     KASSERT ( cv != NULL ) ;
 
-	lock_release ( lock ) ;
+#if OPT_LOCKSTAT
+	start = lockstat_now ( ) ;
+#endif
+
+	// Get on the cv's queue before letting go of the lock, so a
+	// signal in between can't be missed.
 	wchan_lock ( cv -> cv_wchan ) ;
+	lock_release ( lock ) ;
 			
+	// cv_signal/cv_broadcast may move us onto the lock's queue, in
+	// which case we only wake once the lock has been released.
 	wchan_sleep ( cv -> cv_wchan ) ;
+
+#if OPT_LOCKSTAT
+	lockstat_acquired ( cv , LOCKSTAT_CV , cv -> cv_name , true , 0 ,
+			    lockstat_now ( ) - start ) ;
+#endif
 		
 	lock_acquire ( lock ) ;
 
@@ -390,7 +659,10 @@ cv_signal(struct cv *cv, struct lock *lock)
     KASSERT ( cv != NULL ) ;
 	KASSERT ( lock_do_i_hold ( lock ) ) ;
 			
-	wchan_wakeone ( cv -> cv_wchan ) ;
+	// We hold the lock, so there's no point waking the waiter only
+	// for it to block on the lock; move it straight to the lock's
+	// queue and lock_release will wake it. (Wait morphing.)
+	wchan_transferone ( cv -> cv_wchan , lock -> lk_wchan ) ;
 
 	// End of the added stuff
 
@@ -409,10 +681,147 @@ cv_broadcast(struct cv *cv, struct lock *lock)
     KASSERT ( cv != NULL ) ;
 	KASSERT ( lock_do_i_hold ( lock ) ) ;
 		
-	wchan_wakeall ( cv-> cv_wchan ) ;
+	// As in cv_signal; lock_release then wakes the waiters one at
+	// a time as each gets and drops the lock, rather than all at
+	// once to fight over it.
+	wchan_transferall ( cv -> cv_wchan , lock -> lk_wchan ) ;
 
 	// End of the added stuff
 
 	//(void)cv;    // suppress warning until code gets written
 	//(void)lock;  // suppress warning until code gets written
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(struct rwlock));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rwlock_name = kstrdup(name);
+	if (rw->rwlock_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_readwchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_writewchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	rw->rw_readers = 0;
+	rw->rw_writerswaiting = 0;
+	rw->rw_writer = NULL;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_writerswaiting == 0);
+
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+	kfree(rw->rwlock_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	while (rw->rw_writer != NULL || rw->rw_writerswaiting > 0) {
+		wchan_lock(rw->rw_readwchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_readwchan);
+		spinlock_acquire(&rw->rw_lock);
+	}
+	rw->rw_readers++;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0 && rw->rw_writerswaiting > 0) {
+		wchan_wakeone(rw->rw_writewchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	rw->rw_writerswaiting++;
+	while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+		wchan_lock(rw->rw_writewchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_writewchan);
+		spinlock_acquire(&rw->rw_lock);
+	}
+	rw->rw_writerswaiting--;
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	if (rw->rw_writerswaiting > 0) {
+		wchan_wakeone(rw->rw_writewchan);
+	}
+	else {
+		wchan_wakeall(rw->rw_readwchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	return rw->rw_writer == curthread;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Task queues. See taskq.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <taskq.h>
+
+/*
+ * Per-cpu queue. tq_sleeping is set by the thread, with tq_lock held,
+ * just before it goes to sleep on tq_wchan; whoever queues a task and
+ * finds it set clears it and wakes the thread. The thread holds the
+ * wchan lock before dropping tq_lock, so the wakeup can't be lost.
+ */
+struct taskq {
+	struct spinlock tq_lock;
+	struct task *tq_head;		/* Tasks waiting to run */
+	struct task **tq_tailp;		/* Where to link the next one */
+	struct wchan *tq_wchan;		/* Where the thread sleeps */
+	bool tq_sleeping;		/* Thread is (about to be) asleep */
+	unsigned tq_cpunum;		/* Cpu this is for */
+	unsigned tq_ran;		/* Tasks run */
+	unsigned tq_wakeups;		/* Times the thread was woken */
+	struct taskq *tq_nextq;		/* Next on taskq_all */
+};
+
+/* All the queues, for taskq_printstats. */
+static struct spinlock taskq_alllock = SPINLOCK_INITIALIZER;
+static struct taskq *taskq_all;
+
+void
+task_init(struct task *tk, void (*func)(void *, unsigned long),
+	  void *data1, unsigned long data2)
+{
+	tk->tk_next = NULL;
+	spinlock_data_set(&tk->tk_queued, 0);
+	tk->tk_func = func;
+	tk->tk_data1 = data1;
+	tk->tk_data2 = data2;
+}
+
+bool
+taskq_enqueue(struct task *tk)
+{
+	struct taskq *tq;
+	bool wake;
+
+	/*
+	 * Claim the task first; this works whichever cpu's queue it
+	 * was last on.
+	 */
+	if (spinlock_data_testandset(&tk->tk_queued) != 0) {
+		return false;
+	}
+
+	tq = curcpu->c_taskq;
+	KASSERT(tq != NULL);
+
+	spinlock_acquire(&tq->tq_lock);
+	tk->tk_next = NULL;
+	*tq->tq_tailp = tk;
+	tq->tq_tailp = &tk->tk_next;
+	wake = tq->tq_sleeping;
+	if (wake) {
+		tq->tq_sleeping = false;
+		tq->tq_wakeups++;
+	}
+	spinlock_release(&tq->tq_lock);
+
+	if (wake) {
+		wchan_wakeone(tq->tq_wchan);
+	}
+	return true;
+}
+
+/*
+ * The per-cpu thread. Run tasks until there are none left, then
+ * sleep until one is queued.
+ */
+static
+void
+taskq_thread(void *vtq, unsigned long junk)
+{
+	struct taskq *tq = vtq;
+	struct task *tk;
+
+	(void)junk;
+
+	thread_setpriority(PRI_MAX);
+
+	spinlock_acquire(&tq->tq_lock);
+	while (1) {
+		tk = tq->tq_head;
+		if (tk == NULL) {
+			tq->tq_sleeping = true;
+			wchan_lock(tq->tq_wchan);
+			spinlock_release(&tq->tq_lock);
+			wchan_sleep(tq->tq_wchan);
+			spinlock_acquire(&tq->tq_lock);
+			continue;
+		}
+
+		tq->tq_head = tk->tk_next;
+		if (tq->tq_head == NULL) {
+			tq->tq_tailp = &tq->tq_head;
+		}
+		tq->tq_ran++;
+		spinlock_release(&tq->tq_lock);
+
+		/* From here on it can be queued again. */
+		spinlock_data_set(&tk->tk_queued, 0);
+		tk->tk_func(tk->tk_data1, tk->tk_data2);
+
+		spinlock_acquire(&tq->tq_lock);
+	}
+}
+
+void
+taskq_startcpu(void)
+{
+	struct taskq *tq;
+	char name[16];
+	int result;
+
+	KASSERT(curcpu->c_taskq == NULL);
+
+	tq = kmalloc(sizeof(*tq));
+	if (tq == NULL) {
+		panic("taskq_startcpu: Out of memory\n");
+	}
+	spinlock_init(&tq->tq_lock);
+	tq->tq_head = NULL;
+	tq->tq_tailp = &tq->tq_head;
+	tq->tq_wchan = wchan_create("taskq");
+	if (tq->tq_wchan == NULL) {
+		panic("taskq_startcpu: Could not create wchan\n");
+	}
+	tq->tq_sleeping = false;
+	tq->tq_cpunum = curcpu->c_number;
+	tq->tq_ran = 0;
+	tq->tq_wakeups = 0;
+
+	spinlock_acquire(&taskq_alllock);
+	tq->tq_nextq = taskq_all;
+	taskq_all = tq;
+	spinlock_release(&taskq_alllock);
+
+	/* Tasks can be queued from now on; they run once the thread does. */
+	curcpu->c_taskq = tq;
+
+	snprintf(name, sizeof(name), "taskq%u", tq->tq_cpunum);
+	result = thread_fork_pinned(name, taskq_thread, tq, 0);
+	if (result) {
+		panic("taskq_startcpu: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+}
+
+void
+taskq_printstats(void)
+{
+	struct taskq *tq;
+	unsigned ran, wakeups;
+
+	/* The list only ever grows at the head, so no lock is needed. */
+	for (tq = taskq_all; tq != NULL; tq = tq->tq_nextq) {
+		spinlock_acquire(&tq->tq_lock);
+		ran = tq->tq_ran;
+		wakeups = tq->tq_wakeups;
+		spinlock_release(&tq->tq_lock);
+
+		kprintf("cpu%u: %u tasks run, %u wakeups", tq->tq_cpunum,
+			ran, wakeups);
+		if (wakeups > 0) {
+			kprintf(" (%u.%02u tasks per wakeup)",
+				ran / wakeups, (ran % wakeups) * 100 / wakeups);
+		}
+		kprintf("\n");
+	}
+}
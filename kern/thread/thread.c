@@ -49,6 +49,9 @@
 #include <synch.h>
 #include <addrspace.h>
 #include <mainbus.h>
+#include <clock.h>
+#include <taskq.h>
+#include <threadpool.h>
 #include <vnode.h>
 
 #include "opt-synchprobs.h"
@@ -72,6 +75,8 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+static bool thread_steal(void);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -111,6 +116,44 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Initialize the fields of a new or recycled thread, other than the
+ * name and the stack.
+ */
+static
+void
+thread_init(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_lastrun = 0;
+	thread->t_pinned = false;
+	thread->t_proc = NULL;
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_userintr = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* Public fields */
+	thread->t_migrations = 0;
+	thread->t_tid = 0;
+	bzero(&thread->t_ru, sizeof(thread->t_ru));
+	thread->t_basepri = PRI_DEFAULT;
+	thread->t_pri = PRI_DEFAULT;
+	thread->t_blockedon = NULL;
+	thread->t_heldlocks = NULL;
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -133,27 +176,92 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
+	thread_init(thread);
 
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+	return thread;
+}
 
-	/* If you add to struct thread, be sure to initialize here */
+/*
+ * Thread cache.
+ *
+ * Rather than freeing dead threads, thread_destroy keeps up to
+ * THREAD_CACHE_MAX of them per cpu, struct and stack together, and
+ * thread_fork takes them back from there before going to kmalloc.
+ * This saves fork/exit-heavy loads two large allocations and frees
+ * per thread. The stack guard band is left in place while a thread
+ * is cached, and checked when it goes in.
+ *
+ * Each cache belongs to its cpu and is only touched with interrupts
+ * off.
+ */
+#define THREAD_CACHE_MAX	8
+
+/*
+ * Get a thread with a stack from the cache, or NULL if it's empty.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	char *tname;
+	int spl;
+
+	tname = kstrdup(name);
+	if (tname == NULL) {
+		return NULL;
+	}
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	if (thread != NULL) {
+		curcpu->c_threadcache_hits++;
+	}
+	else {
+		curcpu->c_threadcache_misses++;
+	}
+	splx(spl);
+
+	if (thread == NULL) {
+		kfree(tname);
+		return NULL;
+	}
 
+	KASSERT(thread->t_stack != NULL);
+	thread->t_name = tname;
+	thread_init(thread);
 	return thread;
 }
 
+/*
+ * Put a dead thread in the cache, if there's room. Returns true if it
+ * was kept.
+ */
+static
+bool
+thread_cache_put(struct thread *thread)
+{
+	bool kept;
+	int spl;
+
+	KASSERT(thread->t_stack != NULL);
+	thread_checkstack(thread);
+	threadlistnode_init(&thread->t_listnode, thread);
+
+	spl = splhigh();
+	kept = curcpu->c_threadcache.tl_count < THREAD_CACHE_MAX;
+	if (kept) {
+		threadlist_addhead(&curcpu->c_threadcache, thread);
+	}
+	splx(spl);
+
+	if (!kept) {
+		threadlistnode_cleanup(&thread->t_listnode);
+	}
+	return kept;
+}
+
 /*
  * Create a CPU structure. This is used for the bootup CPU and
  * also for secondary CPUs.
@@ -180,8 +288,18 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	c->c_tickstop_secs = 0;
+	c->c_tickstop_nsecs = 0;
+	c->c_tickowner = NULL;
+	c->c_tickcharged_secs = 0;
+	c->c_tickcharged_nsecs = 0;
+	threadlist_init(&c->c_threadcache);
+	c->c_threadcache_hits = 0;
+	c->c_threadcache_misses = 0;
+	c->c_taskq = NULL;
 
 	c->c_isidle = false;
+	c->c_tickstopped = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
 
@@ -227,6 +345,15 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+/*
+ * Return the number of cpus found so far.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
 /*
  * Destroy a thread.
  *
@@ -249,9 +376,6 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
-	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
-	}
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
 
@@ -259,6 +383,16 @@ thread_destroy(struct thread *thread)
 	thread->t_wchan_name = "DESTROYED";
 
 	kfree(thread->t_name);
+	thread->t_name = NULL;
+
+	/* Keep it for reuse if we can */
+	if (thread->t_stack != NULL && thread_cache_put(thread)) {
+		return;
+	}
+
+	if (thread->t_stack != NULL) {
+		kfree(thread->t_stack);
+	}
 	kfree(thread);
 }
 
@@ -402,6 +536,8 @@ cpu_hatch(unsigned software_number)
 
 	kprintf("cpu%u: %s\n", software_number, cpu_identify());
 
+	taskq_startcpu();
+	threadpool_startcpu();
 	V(cpu_startup_sem);
 	thread_exit();
 }
@@ -426,16 +562,120 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Cache affinity.
+ *
+ * A thread that ran on its cpu within the last AFFINITY_HARDCLOCKS
+ * hardclocks is assumed to still have a warm cache there. Such a
+ * thread is only placed elsewhere on wakeup if its cpu's load exceeds
+ * the least loaded cpu's by more than AFFINITY_IMBALANCE. A thread
+ * whose cache has gone cold moves to any less loaded cpu.
+ */
+#define AFFINITY_HARDCLOCKS	2
+#define AFFINITY_IMBALANCE	2
+
+/*
+ * Load of a cpu: queued threads plus the one running, if any. This is
+ * read without the run queue lock, so it is only a hint.
+ */
+static
+unsigned
+cpu_load(struct cpu *c)
+{
+	return c->c_runqueue.tl_count + (c->c_isidle ? 0 : 1);
+}
+
+/*
+ * Return true if T last ran on its cpu recently enough that its
+ * working set is probably still in that cpu's cache.
+ */
+static
+bool
+thread_is_cache_warm(struct thread *t)
+{
+	return t->t_cpu->c_hardclocks - t->t_lastrun <= AFFINITY_HARDCLOCKS;
+}
+
+/*
+ * Choose the cpu a thread about to become runnable should be queued
+ * on: its previous cpu unless that cpu is overloaded compared to the
+ * least loaded one. Ties go to the previous cpu.
+ */
+static
+struct cpu *
+thread_choose_cpu(struct thread *t)
+{
+	struct cpu *prev, *best, *c;
+	unsigned i, numcpus, load, bestload, slack;
+
+	prev = t->t_cpu;
+	if (t->t_pinned) {
+		return prev;
+	}
+	best = prev;
+	bestload = cpu_load(prev);
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		load = cpu_load(c);
+		if (load < bestload) {
+			best = c;
+			bestload = load;
+		}
+	}
+
+	slack = thread_is_cache_warm(t) ? AFFINITY_IMBALANCE : 0;
+	if (cpu_load(prev) <= bestload + slack) {
+		return prev;
+	}
+	return best;
+}
+
+/*
+ * Poke an idle cpu other than BUSY, if there is one, so it comes out
+ * of cpu_idle() and steals work from BUSY instead of waiting for its
+ * next timer interrupt.
+ *
+ * c_isidle is read without holding the other cpu's run queue lock.
+ * A stale value costs at most a spurious or a missed IPI; the timer
+ * interrupt still gets an idle cpu back into the idle loop to look
+ * for work.
+ */
+static
+void
+thread_kick_idle_cpu(struct cpu *busy)
+{
+	unsigned i, numcpus;
+	struct cpu *c;
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == busy || c == curcpu->c_self) {
+			continue;
+		}
+		if (c->c_isidle) {
+			ipi_send(c, IPI_UNIDLE);
+			return;
+		}
+	}
+}
+
 /*
  * Make a thread runnable.
  *
  * targetcpu might be curcpu; it might not be, too. 
+ *
+ * Unless the caller already holds the run queue lock, the thread may
+ * be placed on a different cpu than the one it last ran on; see
+ * thread_choose_cpu().
  */
 static
 void
 thread_make_runnable(struct thread *target, bool already_have_lock)
 {
-	struct cpu *targetcpu;
+	struct cpu *targetcpu, *newcpu;
 	bool isidle;
 
 	/* Lock the run queue of the target thread's cpu. */
@@ -447,6 +687,25 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 	else {
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
+
+		/*
+		 * Holding the old cpu's run queue lock guarantees the
+		 * thread has finished switching out there, unless the
+		 * cpu went idle with it still as curthread (see
+		 * thread_steal), in which case it has to stay put.
+		 */
+		newcpu = thread_choose_cpu(target);
+		if (newcpu != targetcpu &&
+		    targetcpu->c_curthread != target) {
+			spinlock_release(&targetcpu->c_runqueue_lock);
+			target->t_cpu = newcpu;
+			if (target->t_state == S_SLEEP) {
+				/* (new threads haven't run anywhere yet) */
+				target->t_migrations++;
+			}
+			targetcpu = newcpu;
+			spinlock_acquire(&targetcpu->c_runqueue_lock);
+		}
 	}
 
 	isidle = targetcpu->c_isidle;
@@ -458,6 +717,24 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		 */
 		ipi_send(targetcpu, IPI_UNIDLE);
 	}
+	else {
+		/*
+		 * Target processor is busy. If it had switched its
+		 * tick off, it now has something to time-slice
+		 * against, so get it back on. Also give an idle
+		 * processor, if any, the chance to steal the thread
+		 * right away.
+		 */
+		if (targetcpu->c_tickstopped) {
+			if (targetcpu == curcpu->c_self) {
+				hardclock_start();
+			}
+			else {
+				ipi_send(targetcpu, IPI_UNIDLE);
+			}
+		}
+		thread_kick_idle_cpu(targetcpu);
+	}
 
 	if (!already_have_lock) {
 		spinlock_release(&targetcpu->c_runqueue_lock);
@@ -465,20 +742,14 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 }
 
 /*
- * Create a new thread based on an existing one.
- *
- * The new thread has name NAME, and starts executing in function
- * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
- *
- * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * Common portion of thread_fork and thread_fork_pinned.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_dofork(const char *name,
+	      struct proc *proc, bool pinned,
+	      void (*entrypoint)(void *data1, unsigned long data2),
+	      void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
@@ -487,25 +758,35 @@ thread_fork(const char *name,
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
-	/* Thread subsystem fields */
+	/*
+	 * Thread subsystem fields. This is only a starting point;
+	 * thread_make_runnable will put the new thread on a less
+	 * loaded cpu if there is one.
+	 */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_pinned = pinned;
+	newthread->t_basepri = curthread->t_basepri;
+	newthread->t_pri = curthread->t_basepri;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -528,12 +809,72 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock the chosen cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
 
 	return 0;
 }
 
+/*
+ * Create a new thread based on an existing one.
+ *
+ * The new thread has name NAME, and starts executing in function
+ * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
+ *
+ * The new thread is created in the process P. If P is null, the
+ * process is inherited from the caller. It will start on the same CPU
+ * as the caller, unless the scheduler intervenes first.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_dofork(name, proc, false, entrypoint, data1, data2);
+}
+
+/*
+ * Create a new kernel thread that only ever runs on the current cpu.
+ * This is for per-cpu service threads; see taskq.c.
+ */
+int
+thread_fork_pinned(const char *name,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1, unsigned long data2)
+{
+	return thread_dofork(name, kproc, true, entrypoint, data1, data2);
+}
+
+/*
+ * Remove and return the highest-priority thread on TL, taking the one
+ * nearest the head among equals so that threads of the same priority
+ * keep their order. Returns NULL if TL is empty. The caller must hold
+ * whatever lock protects TL.
+ *
+ * This is a linear scan; run queues and wait channels are short
+ * enough that it isn't worth keeping them sorted, and t_pri can be
+ * raised by priority inheritance while a thread sits on one.
+ */
+static
+struct thread *
+thread_takebest(struct threadlist *tl)
+{
+	struct threadlistnode *node;
+	struct thread *best = NULL;
+
+	for (node = tl->tl_head.tln_next; node->tln_self != NULL;
+	     node = node->tln_next) {
+		if (best == NULL || node->tln_self->t_pri > best->t_pri) {
+			best = node->tln_self;
+		}
+	}
+	if (best != NULL) {
+		threadlist_remove(tl, best);
+	}
+	return best;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -542,10 +883,13 @@ thread_fork(const char *name,
  *
  * If NEWSTATE is S_SLEEP, the thread is queued on the wait channel
  * WC. Otherwise WC should be NULL.
+ *
+ * PREEMPTED says the switch is forced on the thread by an interrupt
+ * rather than asked for, for the resource usage counts.
  */
 static
 void
-thread_switch(threadstate_t newstate, struct wchan *wc)
+thread_switch(threadstate_t newstate, struct wchan *wc, bool preempted)
 {
 	struct thread *cur, *next;
 	int spl;
@@ -611,6 +955,13 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		break;
 	}
 	cur->t_state = newstate;
+	cur->t_lastrun = curcpu->c_hardclocks;
+	if (preempted) {
+		cur->t_ru.rc_nivcsw++;
+	}
+	else if (newstate == S_SLEEP || newstate == S_READY) {
+		cur->t_ru.rc_nvcsw++;
+	}
 
 	/*
 	 * Get the next thread. While there isn't one, call md_idle().
@@ -629,11 +980,19 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	 * lock to look at it, this should not be visible or matter.
 	 */
 
+	/*
+	 * Before idling, try to steal a thread from the busiest other
+	 * cpu. Because an idle cpu comes back through here on every
+	 * interrupt, this also picks up work that appears elsewhere
+	 * while we're idle.
+	 */
+
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
-		if (next == NULL) {
+		next = thread_takebest(&curcpu->c_runqueue);
+		if (next == NULL && !thread_steal()) {
+			hardclock_stop();
 			spinlock_release(&curcpu->c_runqueue_lock);
 			cpu_idle();
 			spinlock_acquire(&curcpu->c_runqueue_lock);
@@ -641,6 +1000,18 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	/*
+	 * If more threads are waiting, we need the tick to switch to
+	 * them. Otherwise, if it's off, NEXT is charged for the time
+	 * until it comes back on.
+	 */
+	if (!threadlist_isempty(&curcpu->c_runqueue)) {
+		hardclock_start();
+	}
+	else if (curcpu->c_tickstopped) {
+		hardclock_setowner(next);
+	}
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -804,7 +1175,7 @@ thread_exit(void)
 
 	/* Interrupts off on this processor */
         splhigh();
-	thread_switch(S_ZOMBIE, NULL);
+	thread_switch(S_ZOMBIE, NULL, false);
 	panic("The zombie walks!\n");
 }
 
@@ -814,7 +1185,34 @@ thread_exit(void)
 void
 thread_yield(void)
 {
-	thread_switch(S_READY, NULL);
+	thread_switch(S_READY, NULL, false);
+}
+
+/*
+ * Yield on behalf of an interrupt handler, e.g. because the time
+ * slice is up.
+ */
+void
+thread_preempt(void)
+{
+	KASSERT(curthread->t_in_interrupt);
+	thread_switch(S_READY, NULL, true);
+}
+
+/*
+ * Change the current thread's priority. Locks it holds may keep it
+ * running at a higher one for a while; see lock_inherit_update. Yield
+ * afterwards so that if we've dropped below something waiting to run,
+ * it gets to.
+ */
+void
+thread_setpriority(int pri)
+{
+	KASSERT(pri >= PRI_MIN && pri <= PRI_MAX);
+
+	curthread->t_basepri = pri;
+	lock_inherit_update();
+	thread_yield();
 }
 
 ////////////////////////////////////////////////////////////
@@ -838,123 +1236,202 @@ schedule(void)
 /*
  * Thread migration.
  *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
+ * Rather than having busy CPUs periodically push threads away, a cpu
+ * that runs out of work pulls a thread from the busiest other cpu
+ * when it is about to go idle. This is called from thread_switch()
+ * with the current cpu's run queue locked and empty.
  *
  * Migrating threads isn't free because of cache affinity; a thread's
  * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
+ * which is fairly slow. However, stealing only happens when the cpu
+ * doing it would otherwise sit idle, and System/161 does not (yet)
+ * model such cache effects anyway, so we steal whenever there's
+ * anything at all waiting elsewhere.
+ *
+ * The other cpus' queue lengths are sampled without locking; they
+ * only serve to choose a victim. To avoid deadlock against a cpu
+ * stealing from us at the same moment, the two run queue locks are
+ * always taken in cpu number order, which may mean dropping our own
+ * lock briefly.
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * Returns true if our run queue is no longer empty, either because
+ * we stole something or because something was added while our lock
+ * was dropped. The current cpu's run queue lock is held on return.
  */
-void
-thread_consider_migration(void)
+static
+bool
+thread_steal(void)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
+	struct cpu *self, *victim, *c;
+	struct threadlistnode *node;
 	struct thread *t;
+	unsigned i, numcpus, count, best;
+
+	self = curcpu->c_self;
+	KASSERT(spinlock_do_i_hold(&self->c_runqueue_lock));
 
-	my_count = total_count = 0;
+	victim = NULL;
+	best = 0;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
+		if (c == self) {
+			continue;
+		}
+		count = c->c_runqueue.tl_count;
+		if (count > best) {
+			best = count;
+			victim = c;
 		}
-		spinlock_release(&c->c_runqueue_lock);
 	}
-
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
-		return;
+	if (victim == NULL) {
+		return false;
 	}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	if (victim->c_number < self->c_number) {
+		spinlock_release(&self->c_runqueue_lock);
+		spinlock_acquire(&victim->c_runqueue_lock);
+		spinlock_acquire(&self->c_runqueue_lock);
+		if (!threadlist_isempty(&self->c_runqueue)) {
+			spinlock_release(&victim->c_runqueue_lock);
+			return true;
+		}
+	}
+	else {
+		spinlock_acquire(&victim->c_runqueue_lock);
 	}
-	spinlock_release(&curcpu->c_runqueue_lock);
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
-		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
+	/*
+	 * Take the thread that has gone longest without running on
+	 * the victim, as its cache there is the coldest.
+	 *
+	 * Ordinarily, the victim's curthread will not appear on its
+	 * run queue. However, it can under the following
+	 * circumstances:
+	 *   - it went to sleep;
+	 *   - the processor became idle, so it remained curthread;
+	 *   - it was reawakened, so it was put on the run queue;
+	 *   - and the processor hasn't fully unidled yet, so all
+	 *     these things are still true.
+	 *
+	 * *Migrating* that thread can cause bad things to happen
+	 * (Exercise: Why? And what?) so skip over it. Also skip
+	 * threads pinned to the victim.
+	 */
+	t = NULL;
+	for (node = victim->c_runqueue.tl_head.tln_next;
+	     node->tln_self != NULL;
+	     node = node->tln_next) {
+		if (node->tln_self == victim->c_curthread ||
+		    node->tln_self->t_pinned) {
 			continue;
 		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
+		if (t == NULL ||
+		    node->tln_self->t_lastrun < t->t_lastrun) {
+			t = node->tln_self;
+		}
+	}
+	if (t == NULL) {
+		/* Nothing we're allowed to take. */
+		spinlock_release(&victim->c_runqueue_lock);
+		return false;
+	}
 
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
+	threadlist_remove(&victim->c_runqueue, t);
+	t->t_cpu = self;
+	t->t_migrations++;
+	threadlist_addtail(&self->c_runqueue, t);
+	DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u\n",
+	      t->t_name, victim->c_number, self->c_number);
+
+	spinlock_release(&victim->c_runqueue_lock);
+	return true;
+}
+
+/*
+ * Print scheduler state for each cpu: the running thread and the
+ * threads waiting in the run queue, with how many times each has been
+ * migrated. Sleeping threads aren't on any list we can get at, so
+ * they're not shown.
+ *
+ * kprintf can sleep, so each cpu's state is copied out under its run
+ * queue lock and printed afterwards. Only the first few threads are
+ * copied.
+ */
+#define PRINTSTATS_THREADS 8
+
+struct threadsnap {
+	char ts_name[24];
+	unsigned ts_migrations;
+};
+
+static
+void
+thread_snapone(struct threadsnap *ts, struct thread *t)
+{
+	snprintf(ts->ts_name, sizeof(ts->ts_name), "%s", t->t_name);
+	ts->ts_migrations = t->t_migrations;
+}
+
+void
+thread_printstats(void)
+{
+	unsigned i, j, numcpus, hardclocks, queued, nsnap;
+	bool isidle;
+	struct cpu *c;
+	struct threadlistnode *node;
+	struct threadsnap snap[PRINTSTATS_THREADS];
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		nsnap = 0;
+
+		spinlock_acquire(&c->c_runqueue_lock);
+		hardclocks = c->c_hardclocks;
+		isidle = c->c_isidle;
+		queued = c->c_runqueue.tl_count;
+		if (!isidle) {
+			thread_snapone(&snap[nsnap++], c->c_curthread);
+		}
+		for (node = c->c_runqueue.tl_head.tln_next;
+		     node->tln_self != NULL && nsnap < PRINTSTATS_THREADS;
+		     node = node->tln_next) {
+			thread_snapone(&snap[nsnap++], node->tln_self);
 		}
 		spinlock_release(&c->c_runqueue_lock);
-	}
 
-	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
-	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+		kprintf("cpu%u: %u hardclocks, %s, %u queued\n",
+			c->c_number, hardclocks,
+			isidle ? "idle" : "running", queued);
+		for (j=0; j<nsnap; j++) {
+			kprintf("      %-24s migrations %u\n",
+				snap[j].ts_name, snap[j].ts_migrations);
+		}
+		if (nsnap < queued + (isidle ? 0 : 1)) {
+			kprintf("      ...\n");
 		}
-		spinlock_release(&curcpu->c_runqueue_lock);
 	}
+}
 
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
+/*
+ * Print the thread cache hit rates.
+ */
+void
+thread_cachestats(void)
+{
+	unsigned i, numcpus, total;
+	struct cpu *c;
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		total = c->c_threadcache_hits + c->c_threadcache_misses;
+		kprintf("cpu%u: %u cached, %u hits, %u misses (%u%% hit)\n",
+			c->c_number, c->c_threadcache.tl_count,
+			c->c_threadcache_hits, c->c_threadcache_misses,
+			total == 0 ? 0 : c->c_threadcache_hits * 100 / total);
+	}
 }
 
 ////////////////////////////////////////////////////////////
@@ -1025,11 +1502,12 @@ wchan_sleep(struct wchan *wc)
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
-	thread_switch(S_SLEEP, wc);
+	thread_switch(S_SLEEP, wc, false);
 }
 
 /*
- * Wake up one thread sleeping on a wait channel.
+ * Wake up one thread sleeping on a wait channel: the one with the
+ * highest priority, or the one that's waited longest among those.
  */
 void
 wchan_wakeone(struct wchan *wc)
@@ -1038,7 +1516,7 @@ wchan_wakeone(struct wchan *wc)
 
 	/* Lock the channel and grab a thread from it */
 	spinlock_acquire(&wc->wc_lock);
-	target = threadlist_remhead(&wc->wc_threads);
+	target = thread_takebest(&wc->wc_threads);
 	/*
 	 * Nobody else can wake up this thread now, so we don't need
 	 * to hang onto the lock.
@@ -1090,6 +1568,79 @@ wchan_wakeall(struct wchan *wc)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up one particular thread, if it's sleeping on a wait channel.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct thread *t)
+{
+	struct threadlistnode *node;
+	bool found;
+
+	KASSERT(spinlock_do_i_hold(&wc->wc_lock));
+
+	found = false;
+	for (node = wc->wc_threads.tl_head.tln_next; node->tln_self != NULL;
+	     node = node->tln_next) {
+		if (node->tln_self == t) {
+			found = true;
+			break;
+		}
+	}
+	if (found) {
+		threadlist_remove(&wc->wc_threads, t);
+	}
+	spinlock_release(&wc->wc_lock);
+
+	if (found) {
+		thread_make_runnable(t, false);
+	}
+	return found;
+}
+
+/*
+ * Move one sleeping thread from one wait channel to another.
+ */
+bool
+wchan_transferone(struct wchan *from, struct wchan *to)
+{
+	struct thread *target;
+
+	KASSERT(from != to);
+
+	spinlock_acquire(&from->wc_lock);
+	spinlock_acquire(&to->wc_lock);
+	target = thread_takebest(&from->wc_threads);
+	if (target != NULL) {
+		target->t_wchan_name = to->wc_name;
+		threadlist_addtail(&to->wc_threads, target);
+	}
+	spinlock_release(&to->wc_lock);
+	spinlock_release(&from->wc_lock);
+
+	return target != NULL;
+}
+
+/*
+ * Move all sleeping threads from one wait channel to another.
+ */
+void
+wchan_transferall(struct wchan *from, struct wchan *to)
+{
+	struct thread *target;
+
+	KASSERT(from != to);
+
+	spinlock_acquire(&from->wc_lock);
+	spinlock_acquire(&to->wc_lock);
+	while ((target = threadlist_remhead(&from->wc_threads)) != NULL) {
+		target->t_wchan_name = to->wc_name;
+		threadlist_addtail(&to->wc_threads, target);
+	}
+	spinlock_release(&to->wc_lock);
+	spinlock_release(&from->wc_lock);
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1189,8 +1740,13 @@ interprocessor_interrupt(void)
 	if (bits & (1U << IPI_UNIDLE)) {
 		/*
 		 * The cpu has already unidled itself to take the
-		 * interrupt; don't need to do anything else.
+		 * interrupt. But if it's busy with a thread and had
+		 * switched hardclock off, the sender has queued
+		 * another thread for it, so it needs to time-slice
+		 * again. (If that's spurious, the next hardclock will
+		 * switch it back off.)
 		 */
+		hardclock_start();
 	}
 	if (bits & (1U << IPI_TLBSHOOTDOWN)) {
 		if (curcpu->c_numshootdown == TLBSHOOTDOWN_ALL) {
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Kernel thread pool. See threadpool.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <threadpool.h>
+
+/*
+ * One parallel_for call. It lives on the caller's stack and sits on
+ * tp_pending until as many pool threads as it asked for have picked
+ * it up, or until the caller takes it back because it has run out of
+ * iterations to hand out.
+ */
+struct pfor {
+	void (*pf_func)(void *, unsigned long);
+	void *pf_data;
+	unsigned long pf_n;		/* Number of iterations */
+	unsigned long pf_next;		/* Next iteration to hand out */
+	unsigned pf_wanted;		/* Helpers still wanted */
+	struct semaphore *pf_done;	/* V'd by each helper when done */
+	struct pfor *pf_nextpending;	/* Link for tp_pending */
+};
+
+/*
+ * tp_lock protects the pending list, the counters in each struct
+ * pfor, and tp_idle. tp_worksem counts helpers requested; a pool
+ * thread that downs it and finds nothing pending (because the caller
+ * took the request back) just goes round again.
+ */
+static struct spinlock tp_lock = SPINLOCK_INITIALIZER;
+static struct pfor *tp_pending;
+static struct semaphore *tp_worksem;
+static unsigned tp_idle;		/* Pool threads waiting for work */
+
+/*
+ * Run iterations of PF until there are none left.
+ */
+static
+void
+pfor_work(struct pfor *pf)
+{
+	unsigned long i;
+
+	while (1) {
+		spinlock_acquire(&tp_lock);
+		i = pf->pf_next;
+		if (i < pf->pf_n) {
+			pf->pf_next++;
+		}
+		spinlock_release(&tp_lock);
+
+		if (i >= pf->pf_n) {
+			break;
+		}
+		pf->pf_func(pf->pf_data, i);
+	}
+}
+
+/*
+ * Take PF off the pending list. Call with tp_lock held.
+ */
+static
+void
+pfor_unlink(struct pfor *pf)
+{
+	struct pfor **pp;
+
+	for (pp = &tp_pending; *pp != pf; pp = &(*pp)->pf_nextpending) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = pf->pf_nextpending;
+}
+
+static
+void
+threadpool_thread(void *junk1, unsigned long junk2)
+{
+	struct pfor *pf;
+
+	(void)junk1;
+	(void)junk2;
+
+	while (1) {
+		spinlock_acquire(&tp_lock);
+		tp_idle++;
+		spinlock_release(&tp_lock);
+
+		P(tp_worksem);
+
+		spinlock_acquire(&tp_lock);
+		tp_idle--;
+		pf = tp_pending;
+		if (pf != NULL) {
+			KASSERT(pf->pf_wanted > 0);
+			pf->pf_wanted--;
+			if (pf->pf_wanted == 0) {
+				pfor_unlink(pf);
+			}
+		}
+		spinlock_release(&tp_lock);
+
+		if (pf != NULL) {
+			pfor_work(pf);
+			V(pf->pf_done);
+		}
+	}
+}
+
+void
+parallel_for(unsigned long n,
+	     void (*func)(void *data, unsigned long i), void *data)
+{
+	struct pfor pf;
+	unsigned helpers, i;
+
+	pf.pf_func = func;
+	pf.pf_data = data;
+	pf.pf_n = n;
+	pf.pf_next = 0;
+	pf.pf_wanted = 0;
+	pf.pf_nextpending = NULL;
+	pf.pf_done = NULL;
+
+	/*
+	 * Ask for one helper per iteration beyond the one we'll do
+	 * ourselves, but no more than there are idle pool threads;
+	 * queueing behind busy ones wouldn't make this go faster.
+	 *
+	 * If we can't sleep, which includes when called from panic()
+	 * (interrupts are off and the other cpus are stopped), do it
+	 * all ourselves.
+	 */
+	helpers = 0;
+	if (n > 1 && tp_worksem != NULL && !curthread->t_in_interrupt &&
+	    curthread->t_iplhigh_count == 0) {
+		pf.pf_done = sem_create("parallel_for", 0);
+	}
+	if (pf.pf_done != NULL) {
+		spinlock_acquire(&tp_lock);
+		helpers = tp_idle;
+		if (helpers > n - 1) {
+			helpers = n - 1;
+		}
+		if (helpers > 0) {
+			pf.pf_wanted = helpers;
+			pf.pf_nextpending = tp_pending;
+			tp_pending = &pf;
+		}
+		spinlock_release(&tp_lock);
+
+		for (i=0; i<helpers; i++) {
+			V(tp_worksem);
+		}
+	}
+
+	pfor_work(&pf);
+
+	/*
+	 * Everything has been handed out. Withdraw the request for any
+	 * helpers that haven't turned up yet, and wait for the rest.
+	 */
+	if (helpers > 0) {
+		spinlock_acquire(&tp_lock);
+		if (pf.pf_wanted > 0) {
+			helpers -= pf.pf_wanted;
+			pf.pf_wanted = 0;
+			pfor_unlink(&pf);
+		}
+		spinlock_release(&tp_lock);
+
+		for (i=0; i<helpers; i++) {
+			P(pf.pf_done);
+		}
+	}
+	if (pf.pf_done != NULL) {
+		sem_destroy(pf.pf_done);
+	}
+}
+
+/*
+ * parallel_bzero. Chunks are big enough that a helper's wakeup and
+ * the shared counter are small next to the zeroing; anything that
+ * fits in one chunk is just done here.
+ */
+#define PBZERO_CHUNK	(4 * 4096)
+
+struct pbzero {
+	char *pb_block;
+	size_t pb_len;
+};
+
+static
+void
+pbzero_chunk(void *data, unsigned long i)
+{
+	struct pbzero *pb = data;
+	size_t offset, len;
+
+	offset = i * PBZERO_CHUNK;
+	len = pb->pb_len - offset;
+	if (len > PBZERO_CHUNK) {
+		len = PBZERO_CHUNK;
+	}
+	bzero(pb->pb_block + offset, len);
+}
+
+void
+parallel_bzero(void *block, size_t len)
+{
+	struct pbzero pb;
+
+	if (len <= PBZERO_CHUNK) {
+		bzero(block, len);
+		return;
+	}
+	pb.pb_block = block;
+	pb.pb_len = len;
+	parallel_for(DIVROUNDUP(len, PBZERO_CHUNK), pbzero_chunk, &pb);
+}
+
+void
+threadpool_startcpu(void)
+{
+	int result;
+
+	/* The first cpu up sets up the shared state; it runs alone. */
+	if (tp_worksem == NULL) {
+		tp_worksem = sem_create("threadpool", 0);
+		if (tp_worksem == NULL) {
+			panic("threadpool_startcpu: sem_create failed\n");
+		}
+	}
+
+	result = thread_fork_pinned("threadpool", threadpool_thread,
+				    NULL, 0);
+	if (result) {
+		panic("threadpool_startcpu: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+}
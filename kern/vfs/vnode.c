@@ -33,9 +33,16 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <uio.h>
 #include <synch.h>
+#include <current.h>
 #include <vfs.h>
 #include <vnode.h>
+#include <addrspace.h>
+
+/* For vn_serial */
+static struct spinlock vnode_seriallock = SPINLOCK_INITIALIZER;
+static unsigned vnode_nextserial;
 
 /*
  * Initialize an abstract vnode.
@@ -53,6 +60,11 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	vn->vn_opencount = 0;
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
+	vn->vn_writegen = 0;
+
+	spinlock_acquire(&vnode_seriallock);
+	vn->vn_serial = vnode_nextserial++;
+	spinlock_release(&vnode_seriallock);
 	return 0;
 }
 
@@ -66,6 +78,10 @@ vnode_cleanup(struct vnode *vn)
 	KASSERT(vn->vn_refcount==1);
 	KASSERT(vn->vn_opencount==0);
 
+	if (vn->vn_writegen != 0) {
+		elfcache_vnodegone(vn);
+	}
+
 	vn->vn_ops = NULL;
 	vn->vn_refcount = 0;
 	vn->vn_opencount = 0;
@@ -225,3 +241,43 @@ vnode_check(struct vnode *v, const char *opstr)
 
 	vfs_biglock_release();
 }
+
+/*
+ * VOP_READ, VOP_WRITE and VOP_TRUNCATE. The generation goes up once
+ * the change is made, so that anyone who looked at the file before it
+ * was finished sees a different generation afterwards.
+ */
+int
+vnode_read(struct vnode *v, struct uio *uio)
+{
+	size_t resid;
+	int result;
+
+	resid = uio->uio_resid;
+	result = __VOP(v, read)(v, uio);
+	curthread->t_ru.rc_inbytes += resid - uio->uio_resid;
+	return result;
+}
+
+int
+vnode_write(struct vnode *v, struct uio *uio)
+{
+	size_t resid;
+	int result;
+
+	resid = uio->uio_resid;
+	result = __VOP(v, write)(v, uio);
+	curthread->t_ru.rc_outbytes += resid - uio->uio_resid;
+	v->vn_writegen++;
+	return result;
+}
+
+int
+vnode_truncate(struct vnode *v, off_t pos)
+{
+	int result;
+
+	result = __VOP(v, truncate)(v, pos);
+	v->vn_writegen++;
+	return result;
+}
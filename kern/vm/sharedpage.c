@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2004, 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * The page of kernel data mapped into every process.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
+#include <clock.h>
+#include <vm.h>
+#include <sharedpage.h>
+
+static struct sharedpage *sharedpage;
+static struct spinlock sharedpage_lock = SPINLOCK_INITIALIZER;
+
+void
+sharedpage_bootstrap(void)
+{
+	vaddr_t va;
+
+	va = alloc_kpages(1);
+	if (va == 0) {
+		panic("sharedpage_bootstrap: Out of memory\n");
+	}
+	bzero((void *)va, PAGE_SIZE);
+
+	/*
+	 * The other cpus haven't been started yet, so only this one
+	 * can have its tick stopped. Holding the lock keeps interrupts
+	 * off while we look.
+	 */
+	spinlock_acquire(&sharedpage_lock);
+	sharedpage = (struct sharedpage *)va;
+	sharedpage->sp_ncpus = cpu_count();
+	sharedpage->sp_tickstopped = curcpu->c_tickstopped ? 1 : 0;
+	spinlock_release(&sharedpage_lock);
+
+	sharedpage_tick();
+}
+
+paddr_t
+sharedpage_paddr(void)
+{
+	KASSERT(sharedpage != NULL);
+	return KVADDR_TO_PADDR((vaddr_t)sharedpage);
+}
+
+/*
+ * Set the clock to SECS.NSECS, unless someone else has got further
+ * ahead while we were reading the time; it must not go backwards.
+ * Call with the lock held and the sequence number odd.
+ */
+static
+void
+sharedpage_settime(time_t secs, uint32_t nsecs)
+{
+	KASSERT(spinlock_do_i_hold(&sharedpage_lock));
+	KASSERT((sharedpage->sp_seq & 1) != 0);
+
+	if (secs > sharedpage->sp_secs ||
+	    (secs == sharedpage->sp_secs && nsecs > sharedpage->sp_nsecs)) {
+		sharedpage->sp_secs = secs;
+		sharedpage->sp_nsecs = nsecs;
+	}
+}
+
+void
+sharedpage_tick(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (sharedpage == NULL) {
+		return;
+	}
+
+	gettime(&secs, &nsecs);
+
+	spinlock_acquire(&sharedpage_lock);
+	sharedpage->sp_seq++;
+	sharedpage_settime(secs, nsecs);
+	sharedpage->sp_seq++;
+	spinlock_release(&sharedpage_lock);
+}
+
+/*
+ * The clock is brought up to date in the same update as the count
+ * changes, so that a cpu restarting its tick doesn't let readers take
+ * a time from before it was stopped.
+ */
+void
+sharedpage_tickstopped(bool stopped)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (sharedpage == NULL) {
+		return;
+	}
+
+	gettime(&secs, &nsecs);
+
+	spinlock_acquire(&sharedpage_lock);
+	sharedpage->sp_seq++;
+	sharedpage_settime(secs, nsecs);
+	if (stopped) {
+		KASSERT(sharedpage->sp_tickstopped < sharedpage->sp_ncpus);
+		sharedpage->sp_tickstopped++;
+	}
+	else {
+		KASSERT(sharedpage->sp_tickstopped > 0);
+		sharedpage->sp_tickstopped--;
+	}
+	sharedpage->sp_seq++;
+	spinlock_release(&sharedpage_lock);
+}
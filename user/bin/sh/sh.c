@@ -37,6 +37,7 @@
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <assert.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -152,41 +153,25 @@ dowait(pid_t pid)
 }
 
 #ifdef WNOHANG
-/*
- * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
- */
-static
-int
-dowaitpoll(pid_t pid)
-{
-	int status;
-	pid_t result;
-	result = waitpid(pid, &status, WNOHANG);
-	if (result<0) {
-		warn("pid %d", pid);
-	}
-	else if (result!=0) {
-		printf("pid %d: ", pid);
-		printstatus(status);
-		printf("\n");
-		return 1;
-	}
-	return 0;
-}
-
 /*
  * waitpoll
- * poll all background jobs for having exited.
+ * poll all background jobs for having exited. waits for any child with
+ * WNOHANG, so it costs one call per job that has exited plus one, rather
+ * than one per job.
  */
 static
 void
 waitpoll(void)
 {
-	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
+	int i, status;
+	pid_t pid;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		printf("pid %d: ", pid);
+		printstatus(status);
+		printf("\n");
+		for (i=0; i < MAXBG; i++) {
+			if (bgpids[i] == pid) {
 				bgpids[i] = 0;
 			}
 		}
@@ -292,6 +277,43 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * Microseconds from BEFORE to AFTER.
+ */
+static
+unsigned long
+tvdiff(const struct timeval *before, const struct timeval *after)
+{
+	return (after->tv_sec - before->tv_sec) * 1000000UL
+		+ after->tv_usec - before->tv_usec;
+}
+
+/*
+ * Print the resources used by a command, which is what was added to
+ * our children's totals while we ran and waited for it.
+ */
+static
+void
+print_rusage(const struct rusage *before, const struct rusage *after)
+{
+	unsigned long utime, stime;
+
+	utime = tvdiff(&before->ru_utime, &after->ru_utime);
+	stime = tvdiff(&before->ru_stime, &after->ru_stime);
+	warnx("subprocess usage: %lu.%06lu user %lu.%06lu system, "
+	      "%lu faults, %lu+%lu switches",
+	      utime / 1000000, utime % 1000000,
+	      stime / 1000000, stime % 1000000,
+	      (unsigned long)(after->ru_minflt - before->ru_minflt),
+	      (unsigned long)(after->ru_nvcsw - before->ru_nvcsw),
+	      (unsigned long)(after->ru_nivcsw - before->ru_nivcsw));
+#ifndef HOST
+	warnx("subprocess i/o: %lu bytes in, %lu bytes out",
+	      (unsigned long)(after->ru_inbytes - before->ru_inbytes),
+	      (unsigned long)(after->ru_outbytes - before->ru_outbytes));
+#endif
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
@@ -311,6 +333,8 @@ docommand(char *buf)
 	int bg=0;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
+	struct rusage rubefore, ruafter;
+	int haverusage;
 
 	nargs = 0;
 	for (s = strtok(buf, " \t\r\n"); s; s = strtok(NULL, " \t\r\n")) {
@@ -353,7 +377,9 @@ docommand(char *buf)
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
+	haverusage = !bg && getrusage(RUSAGE_CHILDREN, &rubefore) == 0;
 
+#ifdef HOST
 	pid = fork();
 	switch (pid) {
 		case -1:
@@ -375,6 +401,19 @@ docommand(char *buf)
 		default:
 			break;
 	}
+#else
+	/*
+	 * spawn() is fork() and execv() in one, without copying our
+	 * address space for the child only to throw it away again.
+	 * If the program can't be run, we hear about it here rather
+	 * than from a child that exits 1.
+	 */
+	pid = spawn(args[0], args);
+	if (pid < 0) {
+		warn("%s", args[0]);
+		return _MKWAIT_EXIT(1);
+	}
+#endif
 
 	/* parent */
 	if (bg) {
@@ -401,6 +440,10 @@ docommand(char *buf)
 		      (unsigned long) endsecs, (unsigned long) endnsecs);
 	}
 
+	if (haverusage && getrusage(RUSAGE_CHILDREN, &ruafter) == 0) {
+		print_rusage(&rubefore, &ruafter);
+	}
+
 	return status;
 }
 
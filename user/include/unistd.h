@@ -42,6 +42,7 @@
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
+#include <kern/resource.h>	/* uses struct timeval */
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -61,6 +62,7 @@
  * header files as well, as follows:
  * 
  *     waitpid:  sys/wait.h
+ *     getrusage: sys/resource.h
  *     open:     fcntl.h or sys/fcntl.h
  *     reboot:   sys/reboot.h
  *     ioctl:    sys/ioctl.h
@@ -153,7 +155,16 @@ int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 int __getcwd(char *buf, size_t buflen);
+int __thread_create(void (*start)(int (*)(void *), void *),
+		    int (*func)(void *), void *arg);
+int thread_join(int tid, int *status);
+__DEAD void thread_exit(int status);
+pid_t spawn(const char *prog, char *const *args);
+int getrusage(int who, struct rusage *usage);
+int futex_wait(volatile int *addr, int expected);
+int futex_wake(volatile int *addr, int n);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -162,6 +173,29 @@ int __getcwd(char *buf, size_t buflen);
  */
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
-time_t time(time_t *seconds);			/* calls __time */
+time_t time(time_t *seconds);			/* may call __time */
+int thread_create(int (*func)(void *), void *arg); /* calls __thread_create */
+
+/*
+ * getpid is a wrapper too: it reads the page of kernel data mapped
+ * into every process, as time() does where it can. This always makes
+ * the system call.
+ */
+int __getpid_syscall(void);
+
+/*
+ * Mutex for threads, built on futex_wait/futex_wake. It only makes a
+ * system call when it has to sleep or wake someone up. Initialize
+ * with MUTEX_INITIALIZER or mutex_init().
+ */
+struct mutex {
+	volatile int mx_state;
+};
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init(struct mutex *mx);
+void mutex_lock(struct mutex *mx);
+int mutex_trylock(struct mutex *mx);	/* 0, or -1 with errno EBUSY */
+void mutex_unlock(struct mutex *mx);
 
 #endif /* _UNISTD_H_ */
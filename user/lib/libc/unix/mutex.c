@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * Mutexes on top of futex_wait/futex_wake.
+ *
+ * mx_state is 0 when the mutex is free, 1 when it's held, and 2 when
+ * it's held and someone may be sleeping on it. Only a lock that finds
+ * the mutex held, and an unlock that finds 2, go into the kernel.
+ *
+ * A locker that has to wait always sets 2 before sleeping, and keeps
+ * setting 2 when it takes the mutex after that, since it can't tell
+ * whether anyone else is still asleep. That costs at worst one
+ * futex_wake too many.
+ */
+
+/*
+ * Atomically store VAL in *P and return the old value, using LL/SC.
+ * (The same as spinlock_data_testandset in the kernel, but retrying
+ * until the SC goes through.)
+ */
+static
+int
+mutex_swap(volatile int *p, int val)
+{
+	int x, y;
+
+	do {
+		y = val;
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%2);"		/*   x = *p */
+			"sc %1, 0(%2);"		/*   *p = y; y = success? */
+			".set pop"		/* restore assembler mode */
+			: "=&r" (x), "+r" (y) : "r" (p) : "memory");
+	} while (y == 0);
+
+	return x;
+}
+
+void
+mutex_init(struct mutex *mx)
+{
+	mx->mx_state = 0;
+}
+
+void
+mutex_lock(struct mutex *mx)
+{
+	if (mutex_swap(&mx->mx_state, 1) == 0) {
+		return;
+	}
+	while (mutex_swap(&mx->mx_state, 2) != 0) {
+		/* Fails straight away if it's no longer 2; just retry. */
+		futex_wait(&mx->mx_state, 2);
+	}
+}
+
+int
+mutex_trylock(struct mutex *mx)
+{
+	if (mutex_swap(&mx->mx_state, 1) == 0) {
+		return 0;
+	}
+	/*
+	 * It was held already, and the 1 we stored may have hidden
+	 * sleepers from the unlock; store 2, which is always safe. If
+	 * it got unlocked in the meantime, that gets us the mutex.
+	 */
+	if (mutex_swap(&mx->mx_state, 2) == 0) {
+		return 0;
+	}
+	errno = EBUSY;
+	return -1;
+}
+
+void
+mutex_unlock(struct mutex *mx)
+{
+	if (mutex_swap(&mx->mx_state, 0) == 2) {
+		futex_wake(&mx->mx_state, 1);
+	}
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * mutextest - test the user-level mutex.
+ *
+ * Several threads bump a shared counter under a mutex, with a yield
+ * in the middle of the critical section every so often so that the
+ * others find the mutex held and have to sleep on it. If the mutex
+ * works, no increments get lost.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+
+#define NTHREADS  4
+#define NLOOPS    20000
+
+static struct mutex mx = MUTEX_INITIALIZER;
+static volatile unsigned long counter;
+
+static
+int
+bump(void *junk)
+{
+	struct timespec ts = { 0, 1000000 };
+	unsigned long x;
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NLOOPS; i++) {
+		mutex_lock(&mx);
+		x = counter;
+		if (i % 1000 == 0) {
+			/* Sleeping a bit lets the others pile up. */
+			nanosleep(&ts, NULL);
+		}
+		counter = x + 1;
+		mutex_unlock(&mx);
+	}
+	return 0;
+}
+
+int
+main(void)
+{
+	int tids[NTHREADS];
+	int i, status;
+
+	mutex_lock(&mx);
+	if (mutex_trylock(&mx) == 0) {
+		errx(1, "mutex_trylock got a held mutex");
+	}
+	mutex_unlock(&mx);
+
+	for (i=0; i<NTHREADS; i++) {
+		tids[i] = thread_create(bump, NULL);
+		if (tids[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		if (thread_join(tids[i], &status) < 0) {
+			err(1, "thread_join");
+		}
+	}
+
+	if (counter != (unsigned long)NTHREADS * NLOOPS) {
+		errx(1, "FAILED: counter is %lu, should be %lu", counter,
+		     (unsigned long)NTHREADS * NLOOPS);
+	}
+	printf("mutextest: passed (%lu increments)\n", counter);
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * syscallbench - time system call round trips.
+ *
+ * Makes each of a few cheap system calls many times in a row and
+ * prints the average time per call. getpid does next to nothing in
+ * the kernel, so it mostly measures getting in and out; __time also
+ * copies out to userlevel, and a zero-length write goes through the
+ * VFS to the console. Use it to compare kernels, e.g. with and without
+ * a change to the trap code.
+ *
+ * libc's getpid reads the shared page instead of trapping, so it is
+ * timed both ways. So is time(), which reads the page only while some
+ * cpu's tick is running; run alone on an otherwise idle machine every
+ * tick is off, and it makes the system call like __time.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+#define NCALLS  20000		/* Must be a multiple of 1000 */
+
+/*
+ * Return the microseconds from START to now.
+ */
+static
+unsigned long
+elapsed(time_t startsecs, unsigned long startnsecs)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) == -1) {
+		err(1, "__time");
+	}
+	if (nsecs < startnsecs) {
+		nsecs += 1000000000;
+		secs--;
+	}
+	return (secs - startsecs) * 1000000UL + (nsecs - startnsecs) / 1000;
+}
+
+static
+void
+report(const char *name, unsigned long us)
+{
+	unsigned long each;
+
+	/* nanoseconds per call */
+	each = us / (NCALLS / 1000);
+	printf("%-16s %d calls, %lu.%03lu us each\n", name, NCALLS,
+	       each / 1000, each % 1000);
+}
+
+int
+main(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+	time_t junksecs;
+	unsigned long junknsecs;
+	pid_t pid;
+	int i;
+
+	pid = getpid();
+
+	if (__getpid_syscall() != pid) {
+		errx(1, "getpid and the system call disagree");
+	}
+
+	__time(&secs, &nsecs);
+	for (i=0; i<NCALLS; i++) {
+		if (__getpid_syscall() != pid) {
+			errx(1, "getpid returned a different pid");
+		}
+	}
+	report("getpid (trap)", elapsed(secs, nsecs));
+
+	__time(&secs, &nsecs);
+	for (i=0; i<NCALLS; i++) {
+		if (getpid() != pid) {
+			errx(1, "getpid returned a different pid");
+		}
+	}
+	report("getpid", elapsed(secs, nsecs));
+
+	__time(&secs, &nsecs);
+	for (i=0; i<NCALLS; i++) {
+		if (__time(&junksecs, &junknsecs) == -1) {
+			err(1, "__time");
+		}
+	}
+	report("__time", elapsed(secs, nsecs));
+
+	__time(&secs, &nsecs);
+	for (i=0; i<NCALLS; i++) {
+		if (time(NULL) == -1) {
+			err(1, "time");
+		}
+	}
+	report("time", elapsed(secs, nsecs));
+
+	__time(&secs, &nsecs);
+	for (i=0; i<NCALLS; i++) {
+		if (write(STDOUT_FILENO, "", 0) != 0) {
+			err(1, "write");
+		}
+	}
+	report("write (0 bytes)", elapsed(secs, nsecs));
+
+	return 0;
+}